@@ -1,13 +1,56 @@
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <fstream>
+#include <sstream>
 #include <memory>
 #include <string>
 #include <vector>
 #include <stack>
 #include <chrono>
 #include <limits>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ALGX_PARSE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define ALGX_HAS_RDTSC
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#define ALGX_HAS_RDTSC
+#include <x86intrin.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 
 using namespace std;
@@ -15,27 +58,84 @@ using namespace std;
 
 const uint16_t INVALID_NODE_ID = numeric_limits<uint16_t>::max();
 
+
+/*
+* Writers of 16-bit table fields used by unlinking. Fields may belong to packed
+* structs, so they are passed by address as void*. DirectWrite just writes,
+* undo is then done by walking restored rows and columns
+*/
+struct DirectWrite
+{
+    inline void assign(void* field, uint16_t value)
+    {
+        memcpy(field, &value, sizeof(value));
+    }
+};
+
+
+/*
+* Undo log: every write remembers the field and its old value, so rollback
+* to a checkpoint is a plain pop loop without any re-walking of the table
+*/
+class Trail
+{
+private:
+#pragma pack(push,1)
+    struct Entry
+    {
+        void* m_field;
+        uint16_t m_value;
+    };
+#pragma pack(pop)
+
+    vector<Entry> m_entries;
+
+public:
+    inline void assign(void* field, uint16_t value)
+    {
+        Entry entry;
+        entry.m_field = field;
+        memcpy(&entry.m_value, field, sizeof(value));
+        m_entries.push_back(entry);
+
+        memcpy(field, &value, sizeof(value));
+    }
+
+    inline size_t checkpoint() const { return m_entries.size(); }
+
+    inline void rollback(size_t checkpoint)
+    {
+        while (m_entries.size() > checkpoint)
+        {
+            const Entry& entry = m_entries.back();
+            memcpy(entry.m_field, &entry.m_value, sizeof(entry.m_value));
+            m_entries.pop_back();
+        }
+    }
+
+    inline size_t capacityBytes() const { return m_entries.capacity() * sizeof(Entry); }
+};
+
+
 enum HeaderType
 {
     RowType,
     ColumnType
 };
 
+// Id of a header is its index in the pool, so it is not stored
 #pragma pack(push,1)
 template<HeaderType T>
 struct Header
 {
-    uint16_t m_id;
-
     uint16_t m_nextId;
     uint16_t m_prevId;
 
     uint16_t m_nodesCount = 0;
     uint16_t m_headNodeId = INVALID_NODE_ID;
 
-    Header(uint16_t id, uint16_t nextId, uint16_t prevId)
-        : m_id(id)
-        , m_nextId(nextId)
+    Header(uint16_t nextId, uint16_t prevId)
+        : m_nextId(nextId)
         , m_prevId(prevId)
     {
     }
@@ -64,10 +164,10 @@ struct HeaderList
         assert(length > 0);
 
         m_nodesPool.reserve(length);
-        m_nodesPool.emplace_back(0, 1 % length, length - 1);
+        m_nodesPool.emplace_back(1 % length, length - 1);
         for (int i = 1; i < length; ++i)
         {
-            m_nodesPool.emplace_back(i, (i + 1) % length, i - 1);
+            m_nodesPool.emplace_back((i + 1) % length, i - 1);
         }
     }
 
@@ -88,32 +188,39 @@ struct HeaderList
         return m_nodesPool[id];
     }
 
-    inline Header<T>& eject(uint16_t id)
+    inline uint16_t idOf(const Header<T>& header) const
+    {
+        return static_cast<uint16_t>(&header - m_nodesPool.data());
+    }
+
+    template<typename Writer = DirectWrite>
+    inline Header<T>& eject(uint16_t id, Writer&& writer = Writer())
     {
-        m_nodesPool[m_nodesPool[id].m_prevId].m_nextId = m_nodesPool[id].m_nextId;
-        m_nodesPool[m_nodesPool[id].m_nextId].m_prevId = m_nodesPool[id].m_prevId;
+        writer.assign(&m_nodesPool[m_nodesPool[id].m_prevId].m_nextId, m_nodesPool[id].m_nextId);
+        writer.assign(&m_nodesPool[m_nodesPool[id].m_nextId].m_prevId, m_nodesPool[id].m_prevId);
 
-        --m_length;
+        writer.assign(&m_length, m_length - 1);
 
         if (m_headId == id)
         {
-            m_headId = m_length > 0 ? m_nodesPool[m_headId].m_nextId : INVALID_NODE_ID;
+            writer.assign(&m_headId, m_length > 0 ? m_nodesPool[m_headId].m_nextId : INVALID_NODE_ID);
         }
 
         return m_nodesPool[id];
     }
 
-    inline void restore(Header<T>& header)
+    inline void restore(uint16_t id)
     {
-        m_nodesPool[header.m_prevId].m_nextId = header.m_id;
-        m_nodesPool[header.m_nextId].m_prevId = header.m_id;
+        Header<T>& header = m_nodesPool[id];
+        m_nodesPool[header.m_prevId].m_nextId = id;
+        m_nodesPool[header.m_nextId].m_prevId = id;
 
         ++m_length;
 
         // INVALID_NODE_ID is always bigger than any valid id
-        if (header.m_id < m_headId)
+        if (id < m_headId)
         {
-            m_headId = header.m_id;
+            m_headId = id;
         }
     }
 };
@@ -123,12 +230,13 @@ using RowHeader = Header<RowType>;
 using ColumnHeader = Header<ColumnType>;
 
 
+/*
+* Id of a node is its index in the pool. Row id is needed off the hot
+* paths mostly, so SparseTable keeps it in a side array
+*/
 #pragma pack(push,1)
 struct TableNode
 {
-    uint16_t m_id;
-
-    uint16_t m_rowId;
     uint16_t m_columnId;
 
     uint16_t m_leftId  = INVALID_NODE_ID;
@@ -136,10 +244,8 @@ struct TableNode
     uint16_t m_upId    = INVALID_NODE_ID;
     uint16_t m_downId  = INVALID_NODE_ID;
 
-    TableNode(uint16_t id, uint16_t rowId, uint16_t columnId)
-        : m_id(id)
-        , m_rowId(rowId)
-        , m_columnId(columnId)
+    explicit TableNode(uint16_t columnId)
+        : m_columnId(columnId)
     {
     }
 
@@ -150,19 +256,111 @@ struct TableNode
 #pragma pack(pop)
 
 
+/*
+* Bytes held by a solver: pool capacities rather than sizes, undo peak is the
+* largest amount of backup frames alive at once over all searches so far
+*/
+struct MemoryFootprint
+{
+    size_t m_objects = 0;
+    size_t m_nodes = 0;
+    size_t m_headers = 0;
+    size_t m_undoPeak = 0;
+    size_t m_buffers = 0;
+
+    inline size_t total() const { return m_objects + m_nodes + m_headers + m_undoPeak + m_buffers; }
+};
+
+
+void printMemoryFootprint(ostream& stream, const MemoryFootprint& footprint)
+{
+    stream << "objects=" << footprint.m_objects << " nodes=" << footprint.m_nodes << " headers=" << footprint.m_headers <<
+        " undo-peak=" << footprint.m_undoPeak << " buffers=" << footprint.m_buffers << " total=" << footprint.total() << " bytes";
+}
+
+
+#ifdef ALGX_MEMS
+/*
+* Knuth-style cost counters, machine independent. A mem is one read or write
+* of a node or header, a link update is one changed left/right/up/down or
+* next/prev link. Compiled in only with ALGX_MEMS
+*/
+struct MemsCounters
+{
+    uint64_t m_mems = 0;
+    uint64_t m_linkUpdates = 0;
+
+    // Per search level: link updates made while covering there, solutions found there
+    vector<uint64_t> m_levelUpdates;
+    vector<uint32_t> m_levelSolutions;
+
+    void clear()
+    {
+        m_mems = 0;
+        m_linkUpdates = 0;
+        m_levelUpdates.clear();
+        m_levelSolutions.clear();
+    }
+};
+
+#define ALGX_COUNT_MEMS(counters, mems, updates) ((counters).m_mems += (mems), (counters).m_linkUpdates += (updates))
+
+
+void printMemsCounters(ostream& stream, const MemsCounters& counters)
+{
+    stream << " mems=" << counters.m_mems << " updates=" << counters.m_linkUpdates << " level-updates=";
+    for (size_t level = 0; level < counters.m_levelUpdates.size(); ++level)
+        stream << (level > 0 ? "," : "") << counters.m_levelUpdates[level];
+
+    for (size_t level = 0; level < counters.m_levelSolutions.size(); ++level)
+    {
+        if (counters.m_levelSolutions[level] > 0)
+            stream << " solutions@" << level << "=" << counters.m_levelSolutions[level];
+    }
+}
+#else
+#define ALGX_COUNT_MEMS(counters, mems, updates) ((void)0)
+#endif
+
+
+/*
+* Order of nodes in the pool. Build keeps createNode call order, row major puts
+* nodes of a row next to each other, column major does so for a column, which
+* is what ejecting a row touches: up and down neighbours of its nodes
+*/
+enum class NodeOrder : uint8_t
+{
+    Build,
+    RowMajor,
+    ColumnMajor
+};
+
+
+/*
+* Search enters rows through columns only, so the list of live rows may be
+* left as built (ROW_LIST off): ejecting a row then touches its nodes and
+* nothing else
+*/
+template<bool ROW_LIST = true>
 class SparseTable
 {
 public:
     vector<TableNode> m_nodesPool;
+    vector<uint16_t> m_nodeRows;
 
     HeaderList<RowType> m_rows;
     HeaderList<ColumnType> m_columns;
 
+#ifdef ALGX_MEMS
+    MemsCounters m_counters;
+#endif
+
     SparseTable(uint16_t rowsCount, uint16_t columnsCount, uint16_t nodesCount)
         : m_rows(rowsCount)
         , m_columns(columnsCount)
     {
         m_nodesPool.reserve(nodesCount);
+        m_nodeRows.reserve(nodesCount);
     }
 
     SparseTable(const SparseTable&) = delete;
@@ -170,10 +368,11 @@ public:
 
     void createNode(uint16_t rowId, uint16_t columnId)
     {
-        assert(rowId >= 0 && rowId < m_rows.m_length && columnId >= 0 && columnId < m_columns.m_length);
+        assert(rowId < m_rows.m_nodesPool.size() && columnId < m_columns.m_nodesPool.size());
 
         const uint16_t nodeId = static_cast<uint16_t>(m_nodesPool.size());
-        m_nodesPool.emplace_back(nodeId, rowId, columnId);
+        m_nodesPool.emplace_back(columnId);
+        m_nodeRows.push_back(rowId);
         TableNode& node = m_nodesPool.back();
 
         auto& row = m_rows.get(rowId);
@@ -208,7 +407,7 @@ public:
             node.m_upId = nodeId;
             node.m_downId = nodeId;
         }
-        else if (m_nodesPool[column.m_headNodeId].m_rowId > rowId)
+        else if (m_nodeRows[column.m_headNodeId] > rowId)
         {
             // Need to move head down
             vInsertAfter(nodeId, m_nodesPool[column.m_headNodeId].m_upId);
@@ -217,7 +416,7 @@ public:
         else
         {
             uint16_t targetId = column.m_headNodeId;
-            while (m_nodesPool[targetId].m_downId != column.m_headNodeId && m_nodesPool[m_nodesPool[targetId].m_downId].m_rowId < rowId)
+            while (m_nodesPool[targetId].m_downId != column.m_headNodeId && m_nodeRows[m_nodesPool[targetId].m_downId] < rowId)
                 targetId = m_nodesPool[targetId].m_downId;
 
             vInsertAfter(nodeId, targetId);
@@ -227,6 +426,73 @@ public:
         ++column.m_nodesCount;
     }
 
+    /*
+    * Moves nodes to their places in the given order and rewrites links, head
+    * nodes and row ids to match. Only for a freshly built table: all rows live
+    * and all nodes in their columns
+    */
+    void renumberNodes(NodeOrder order)
+    {
+        assert(m_rows.length() == m_rows.m_nodesPool.size());
+        if (order == NodeOrder::Build)
+            return;
+
+        // Old id of a node in its new place
+        vector<uint16_t> oldIds;
+        oldIds.reserve(m_nodesPool.size());
+
+        const bool rowMajor = order == NodeOrder::RowMajor;
+        const size_t listsCount = rowMajor ? m_rows.m_nodesPool.size() : m_columns.m_nodesPool.size();
+        for (size_t listId = 0; listId < listsCount; ++listId)
+        {
+            const uint16_t headNodeId = rowMajor ? m_rows.get(listId).m_headNodeId : m_columns.get(listId).m_headNodeId;
+            if (headNodeId == INVALID_NODE_ID)
+                continue;
+
+            uint16_t nodeId = headNodeId;
+            do
+            {
+                oldIds.push_back(nodeId);
+                nodeId = rowMajor ? m_nodesPool[nodeId].m_rightId : m_nodesPool[nodeId].m_downId;
+            } while (nodeId != headNodeId);
+        }
+        assert(oldIds.size() == m_nodesPool.size());
+
+        vector<uint16_t> newIds(m_nodesPool.size());
+        for (size_t id = 0; id < oldIds.size(); ++id)
+            newIds[oldIds[id]] = static_cast<uint16_t>(id);
+
+        vector<TableNode> nodesPool;
+        vector<uint16_t> nodeRows;
+        nodesPool.reserve(m_nodesPool.capacity());
+        nodeRows.reserve(m_nodeRows.capacity());
+        for (uint16_t oldId : oldIds)
+        {
+            const TableNode& old = m_nodesPool[oldId];
+            nodesPool.emplace_back(old.m_columnId);
+            TableNode& node = nodesPool.back();
+            node.m_leftId = newIds[old.m_leftId];
+            node.m_rightId = newIds[old.m_rightId];
+            node.m_upId = newIds[old.m_upId];
+            node.m_downId = newIds[old.m_downId];
+            nodeRows.push_back(m_nodeRows[oldId]);
+        }
+
+        for (auto& row : m_rows.m_nodesPool)
+        {
+            if (!row.isEmpty())
+                row.m_headNodeId = newIds[row.m_headNodeId];
+        }
+        for (auto& column : m_columns.m_nodesPool)
+        {
+            if (!column.isEmpty())
+                column.m_headNodeId = newIds[column.m_headNodeId];
+        }
+
+        m_nodesPool.swap(nodesPool);
+        m_nodeRows.swap(nodeRows);
+    }
+
     // Insert X horizontally after node Y
     void hInsertAfter(uint16_t xId, uint16_t yId)
     {
@@ -251,28 +517,35 @@ public:
         m_nodesPool[x.m_downId].m_upId = xId;
     }
 
-    inline void removeFromColumn(uint16_t nodeId)
+    template<typename Writer = DirectWrite>
+    inline void removeFromColumn(uint16_t nodeId, Writer&& writer = Writer())
     {
+        // Node itself, two neighbours and the header
+        ALGX_COUNT_MEMS(m_counters, 4, 2);
+
         auto& node = m_nodesPool[nodeId];
 
-        m_nodesPool[node.m_upId].m_downId = node.m_downId;
-        m_nodesPool[node.m_downId].m_upId = node.m_upId;
+        writer.assign(&m_nodesPool[node.m_upId].m_downId, node.m_downId);
+        writer.assign(&m_nodesPool[node.m_downId].m_upId, node.m_upId);
 
         // Update head if needed
         auto& column = m_columns.get(node.m_columnId);
         if (column.m_headNodeId == nodeId)
         {
             if (column.m_nodesCount > 1)
-                column.m_headNodeId = node.m_downId;
+                writer.assign(&column.m_headNodeId, node.m_downId);
             else
-                column.m_headNodeId = INVALID_NODE_ID;
+                writer.assign(&column.m_headNodeId, INVALID_NODE_ID);
         }
 
-        --column.m_nodesCount;
+        writer.assign(&column.m_nodesCount, column.m_nodesCount - 1);
     }
 
     inline void restoreInColumn(uint16_t nodeId)
     {
+        // Node itself, two neighbours and the header
+        ALGX_COUNT_MEMS(m_counters, 4, 2);
+
         auto& node = m_nodesPool[nodeId];
 
         m_nodesPool[node.m_upId].m_downId = nodeId;
@@ -280,57 +553,67 @@ public:
 
         // Update head if needed
         auto& column = m_columns.get(node.m_columnId);
-        if (column.isEmpty() || m_nodesPool[column.m_headNodeId].m_rowId > node.m_rowId)
+        if (column.isEmpty() || m_nodeRows[column.m_headNodeId] > m_nodeRows[nodeId])
             column.m_headNodeId = nodeId;
 
         ++column.m_nodesCount;
     }
 
-    inline void removeFromRow(uint16_t nodeId)
+    template<typename Writer = DirectWrite>
+    inline void removeFromRow(uint16_t nodeId, Writer&& writer = Writer())
     {
+        // Node itself, two neighbours and the header
+        ALGX_COUNT_MEMS(m_counters, 4, 2);
+
         auto& node = m_nodesPool[nodeId];
 
-        m_nodesPool[node.m_rightId].m_leftId = node.m_leftId;
-        m_nodesPool[node.m_leftId].m_rightId = node.m_rightId;
+        writer.assign(&m_nodesPool[node.m_rightId].m_leftId, node.m_leftId);
+        writer.assign(&m_nodesPool[node.m_leftId].m_rightId, node.m_rightId);
 
         // Update head if needed
-        auto& row = m_rows.get(node.m_rowId);
+        auto& row = m_rows.get(m_nodeRows[nodeId]);
         if (row.m_headNodeId == nodeId)
         {
             if (row.m_nodesCount > 1)
-                row.m_headNodeId = node.m_rightId;
+                writer.assign(&row.m_headNodeId, node.m_rightId);
             else
-                row.m_headNodeId = INVALID_NODE_ID;
+                writer.assign(&row.m_headNodeId, INVALID_NODE_ID);
         }
 
-        --row.m_nodesCount;
+        writer.assign(&row.m_nodesCount, row.m_nodesCount - 1);
     }
 
     inline void restoreInRow(uint16_t nodeId)
     {
+        // Node itself, two neighbours and the header
+        ALGX_COUNT_MEMS(m_counters, 4, 2);
+
         auto& node = m_nodesPool[nodeId];
 
         m_nodesPool[node.m_rightId].m_leftId = nodeId;
         m_nodesPool[node.m_leftId].m_rightId = nodeId;
 
         // Update head if needed
-        auto& row = m_rows.get(node.m_rowId);
+        auto& row = m_rows.get(m_nodeRows[nodeId]);
         if (row.isEmpty() || m_nodesPool[row.m_headNodeId].m_columnId > node.m_columnId)
             row.m_headNodeId = nodeId;
 
         ++row.m_nodesCount;
     }
 
-    inline void ejectColumn(int id)
+    // Writes go through the writer, a Trail makes them undoable by rollback
+    template<typename Writer = DirectWrite>
+    inline void ejectColumn(int id, Writer&& writer = Writer())
     {
-        ColumnHeader& column = m_columns.eject(id);
+        ALGX_COUNT_MEMS(m_counters, 3, 2);
+        ColumnHeader& column = m_columns.eject(id, writer);
 
         if (column.m_nodesCount > 0)
         {
             uint16_t nodeId = column.m_headNodeId;
             do
             {
-                removeFromRow(nodeId);
+                removeFromRow(nodeId, writer);
                 nodeId = m_nodesPool[nodeId].m_downId;
             } while (nodeId != column.m_headNodeId);
         }
@@ -338,8 +621,9 @@ public:
 
     inline void restoreColumn(uint16_t columnId)
     {
+        ALGX_COUNT_MEMS(m_counters, 3, 2);
         auto& column = m_columns.get(columnId);
-        m_columns.restore(column);
+        m_columns.restore(columnId);
 
         if (column.m_nodesCount > 0)
         {
@@ -352,16 +636,28 @@ public:
         }
     }
 
-    inline void ejectRow(int id)
+    template<typename Writer = DirectWrite>
+    inline void ejectRow(int id, Writer&& writer = Writer())
     {
-        RowHeader& row = m_rows.eject(id);
+        RowHeader* rowPtr;
+        if constexpr (ROW_LIST)
+        {
+            ALGX_COUNT_MEMS(m_counters, 3, 2);
+            rowPtr = &m_rows.eject(id, writer);
+        }
+        else
+        {
+            ALGX_COUNT_MEMS(m_counters, 1, 0);
+            rowPtr = &m_rows.get(id);
+        }
+        RowHeader& row = *rowPtr;
 
         if (row.m_nodesCount > 0)
         {
             uint16_t nodeId = row.m_headNodeId;
             do
             {
-                removeFromColumn(nodeId);
+                removeFromColumn(nodeId, writer);
                 nodeId = m_nodesPool[nodeId].m_rightId;
             } while (nodeId != row.m_headNodeId);
         }
@@ -370,7 +666,15 @@ public:
     inline void restoreRow(uint16_t rowId)
     {
         auto& row = m_rows.get(rowId);
-        m_rows.restore(row);
+        if constexpr (ROW_LIST)
+        {
+            ALGX_COUNT_MEMS(m_counters, 3, 2);
+            m_rows.restore(rowId);
+        }
+        else
+        {
+            ALGX_COUNT_MEMS(m_counters, 1, 0);
+        }
 
         if (row.m_nodesCount > 0)
         {
@@ -383,6 +687,72 @@ public:
         }
     }
 
+    // Nodes and headers are copied as a whole, so the immutable ids go along
+    inline size_t stateBytes() const
+    {
+        return m_nodesPool.size() * sizeof(TableNode) + m_rows.m_nodesPool.size() * sizeof(RowHeader) +
+            m_columns.m_nodesPool.size() * sizeof(ColumnHeader) + 4 * sizeof(uint16_t);
+    }
+
+    void saveState(char* out) const
+    {
+        const uint16_t lists[4] = { m_rows.m_headId, m_rows.m_length, m_columns.m_headId, m_columns.m_length };
+        memcpy(out, lists, sizeof(lists));
+        out += sizeof(lists);
+
+        memcpy(out, m_nodesPool.data(), m_nodesPool.size() * sizeof(TableNode));
+        out += m_nodesPool.size() * sizeof(TableNode);
+        memcpy(out, m_rows.m_nodesPool.data(), m_rows.m_nodesPool.size() * sizeof(RowHeader));
+        out += m_rows.m_nodesPool.size() * sizeof(RowHeader);
+        memcpy(out, m_columns.m_nodesPool.data(), m_columns.m_nodesPool.size() * sizeof(ColumnHeader));
+    }
+
+    void loadState(const char* in)
+    {
+        uint16_t lists[4];
+        memcpy(lists, in, sizeof(lists));
+        in += sizeof(lists);
+        m_rows.m_headId = lists[0];
+        m_rows.m_length = lists[1];
+        m_columns.m_headId = lists[2];
+        m_columns.m_length = lists[3];
+
+        memcpy(static_cast<void*>(m_nodesPool.data()), in, m_nodesPool.size() * sizeof(TableNode));
+        in += m_nodesPool.size() * sizeof(TableNode);
+        memcpy(static_cast<void*>(m_rows.m_nodesPool.data()), in, m_rows.m_nodesPool.size() * sizeof(RowHeader));
+        in += m_rows.m_nodesPool.size() * sizeof(RowHeader);
+        memcpy(static_cast<void*>(m_columns.m_nodesPool.data()), in, m_columns.m_nodesPool.size() * sizeof(ColumnHeader));
+    }
+
+    void addFootprint(MemoryFootprint& footprint) const
+    {
+        footprint.m_nodes += m_nodesPool.capacity() * sizeof(TableNode) + m_nodeRows.capacity() * sizeof(uint16_t);
+        footprint.m_headers += m_rows.m_nodesPool.capacity() * sizeof(RowHeader) + m_columns.m_nodesPool.capacity() * sizeof(ColumnHeader);
+    }
+
+    inline uint16_t rowOf(uint16_t nodeId) const
+    {
+        return m_nodeRows[nodeId];
+    }
+
+    // First of the columns with the least nodes among the ones in the list
+    ColumnHeader* findShortestColumn()
+    {
+        ColumnHeader* shortest = &m_columns.head();
+
+        uint16_t columnId = m_columns.m_headId;
+        do
+        {
+            ALGX_COUNT_MEMS(m_counters, 1, 0);
+            ColumnHeader* p = &m_columns.get(columnId);
+            if (p->m_nodesCount < shortest->m_nodesCount)
+                shortest = p;
+            columnId = p->m_nextId;
+        } while (columnId != m_columns.m_headId);
+
+        return shortest;
+    }
+
     void dumpDebugRepr(uint16_t nodeId, ostream& stream)
     {
         auto& node = m_nodesPool[nodeId];
@@ -391,11 +761,11 @@ public:
         auto& up = m_nodesPool[node.m_upId];
         auto& down = m_nodesPool[node.m_downId];
 
-        stream << "Node (" << node.m_rowId << "; " << node.m_columnId << "): " <<
-            "LEFT=("  << left.m_rowId  << "; " << left.m_columnId  << ") " <<
-            "RIGHT=(" << right.m_rowId << "; " << right.m_columnId << ") " <<
-            "UP=("    << up.m_rowId    << "; " << up.m_columnId    << ") " <<
-            "DOWN=("  << down.m_rowId  << "; " << down.m_columnId  << ")" << endl;
+        stream << "Node (" << m_nodeRows[nodeId] << "; " << node.m_columnId << "): " <<
+            "LEFT=("  << m_nodeRows[node.m_leftId]  << "; " << left.m_columnId  << ") " <<
+            "RIGHT=(" << m_nodeRows[node.m_rightId] << "; " << right.m_columnId << ") " <<
+            "UP=("    << m_nodeRows[node.m_upId]    << "; " << up.m_columnId    << ") " <<
+            "DOWN=("  << m_nodeRows[node.m_downId]  << "; " << down.m_columnId  << ")" << endl;
     }
 
     /*
@@ -408,6 +778,8 @@ public:
 
         // General information first
         fp << "Matrix size: (" << m_rows.length() << "; " << m_columns.length() << ")" << endl;
+        if (!ROW_LIST)
+            fp << "Row list is not kept, ejected rows are listed too" << endl;
         fp << "--------------------" << endl;
 
         // Rows general information
@@ -416,7 +788,7 @@ public:
             do
             {
                 auto& rp = m_rows.get(rowId);
-                fp << "Row " << rp.m_id << " has " << rp.m_nodesCount << " nodes" << endl;
+                fp << "Row " << rowId << " has " << rp.m_nodesCount << " nodes" << endl;
                 rowId = rp.m_nextId;
             } while (rowId != m_rows.m_headId);
         }
@@ -429,7 +801,7 @@ public:
             do
             {
                 auto& cp = m_columns.get(columnId);
-                fp << "Column " << cp.m_id << " has " << cp.m_nodesCount << " nodes" << endl;
+                fp << "Column " << columnId << " has " << cp.m_nodesCount << " nodes" << endl;
                 columnId = cp.m_nextId;
             } while (columnId != m_columns.m_headId);
         }
@@ -442,7 +814,7 @@ public:
             do
             {
                 auto& rp = m_rows.get(rowId);
-                fp << "Row " << rp.m_id << " nodes:" << endl;
+                fp << "Row " << rowId << " nodes:" << endl;
 
                 if (!rp.isEmpty())
                 {
@@ -464,7 +836,7 @@ public:
         do
         {
             auto& cp = m_columns.get(columnId);
-            fp << "Column " << cp.m_id << " nodes:" << endl;
+            fp << "Column " << columnId << " nodes:" << endl;
 
             if (!cp.isEmpty())
             {
@@ -482,281 +854,4561 @@ public:
     }
 };
 
-class AlgorithmX
+/*
+* Search tree statistics gathered while solving. Depth counts levels
+* of the search only, sets fixed up front by select() are not included
+*/
+struct SearchStats
 {
-private:
-    SparseTable m_table;
-    bool m_finished = false;
-    vector<uint16_t> m_finalSolution;
+    uint32_t m_nodesVisited = 0;
+    uint32_t m_backtracks = 0;
+    uint32_t m_forcedSteps = 0;
+    uint32_t m_maxDepth = 0;
 
-public:
-    AlgorithmX(uint16_t setsCount, uint16_t universeSize, uint16_t nodesCount)
-        : m_table(setsCount, universeSize, nodesCount)
+    // Per level: times it was entered and sum of pivot column sizes there
+    vector<uint32_t> m_levelVisits;
+    vector<uint32_t> m_levelBranches;
+
+    void clear()
     {
+        m_nodesVisited = 0;
+        m_backtracks = 0;
+        m_forcedSteps = 0;
+        m_maxDepth = 0;
+        m_levelVisits.clear();
+        m_levelBranches.clear();
     }
 
-    inline void createNode(uint16_t setId, uint16_t id)
+    inline double branchingFactor(size_t level) const
     {
-        m_table.createNode(setId, id);
+        return level < m_levelVisits.size() && m_levelVisits[level] > 0 ? static_cast<double>(m_levelBranches[level]) / m_levelVisits[level] : 0;
     }
 
-    inline const vector<uint16_t>& getSolution() const { return m_finalSolution; }
-
-    bool solve()
+    // Rows beyond the first one to pick from, summed over all visits; forced steps add none
+    uint32_t guesses() const
     {
-        assert(!m_finished);
+        uint32_t count = 0;
+        for (size_t level = 0; level < m_levelVisits.size(); ++level)
+            count += m_levelBranches[level] - m_levelVisits[level];
+        return count;
+    }
+};
 
-        vector<uint16_t> solution;
-        solveIteration(solution);
 
-        // Prevent double execution
-        m_finished = true;
+enum class TraceOutcome : uint8_t
+{
+    // Row tried, subtree finished the search
+    Done,
+    // Row tried, search went on with the next row
+    Backtrack,
+    // Leaves: pivot column without rows, all columns covered
+    DeadEnd,
+    Solution
+};
 
-        return m_finalSolution.size() != 0;
-    }
 
+#pragma pack(push,1)
+/*
+* One search tree node in the order it was entered. Leaves have no row,
+* solution leaves have no column either
+*/
+struct TraceRecord
+{
+    uint16_t m_depth;
+    uint16_t m_columnId;
+    uint16_t m_columnSize;
+    uint16_t m_rowId;
+    TraceOutcome m_outcome;
+};
+#pragma pack(pop)
+
+
+/*
+* Ring buffer of the last search tree nodes. Outcome of a tried row is known
+* only when its subtree is done, it is patched in if the record is still there
+*/
+class SearchTrace
+{
 private:
-    struct BackupFrame
-    {
-        uint16_t m_columnId = INVALID_NODE_ID;
-        vector<uint16_t> m_rowIds;
-    };
+    vector<TraceRecord> m_records;
+    uint64_t m_total = 0;
 
-    ColumnHeader* findPivotColumn()
+public:
+    explicit SearchTrace(size_t capacity = 1 << 16)
+        : m_records(capacity)
     {
-        ColumnHeader* p = &m_table.m_columns.head();
-        ColumnHeader* pivot = &m_table.m_columns.head();
-
-        do
-        {
-            if (p->m_nodesCount < pivot->m_nodesCount)
-                pivot = p;
-            p = &m_table.m_columns.get(p->m_nextId);
-        } while (p->m_id != m_table.m_columns.m_headId);
+        assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    }
 
-        return pivot;
+    inline uint64_t push(const TraceRecord& record)
+    {
+        m_records[m_total & (m_records.size() - 1)] = record;
+        return m_total++;
     }
 
-    bool solveIteration(vector<uint16_t>& solution)
+    inline void setOutcome(uint64_t index, TraceOutcome outcome)
     {
-        if (m_table.m_columns.length() == 0)
-        {
-            // We have solution
+        if (m_total - index <= m_records.size())
+            m_records[index & (m_records.size() - 1)].m_outcome = outcome;
+    }
 
-            m_finalSolution = solution;
+    void clear() { m_total = 0; }
 
-            return true;
-        }
+    inline size_t size() const { return static_cast<size_t>(min<uint64_t>(m_total, m_records.size())); }
+    inline uint64_t dropped() const { return m_total - size(); }
 
-        ColumnHeader* pivotColumn = findPivotColumn();
-        if (pivotColumn->m_nodesCount == 0)
-            return false;
+    // Records from the oldest kept one
+    inline const TraceRecord& operator[](size_t i) const { return m_records[(dropped() + i) & (m_records.size() - 1)]; }
+};
 
-        uint16_t startingPivotRowId = m_table.m_nodesPool[pivotColumn->m_headNodeId].m_rowId;
-        RowHeader* pivotRow = &m_table.m_rows.get(startingPivotRowId);
-        do
-        {
-            // Preparations 
-            m_table.ejectRow(pivotRow->m_id);
-            vector<BackupFrame> backup;
-            backup.reserve(pivotRow->m_nodesCount);
 
-            TableNode* node = &m_table.m_nodesPool[pivotRow->m_headNodeId];
-            do
-            {
-                backup.emplace_back();
-                BackupFrame& frame = backup.back();
-                auto& column = m_table.m_columns.get(node->m_columnId);
-                if (column.m_nodesCount > 0)
-                {
-                    frame.m_rowIds.reserve(column.m_nodesCount);
+enum class UndoStrategy : uint8_t
+{
+    // Restore rows and columns by walking them back in reverse order
+    Walk,
+    // Roll back a log of every field written while covering
+    Trail,
+    // Copy the whole mutable table state once per level, copy it back on backtrack
+    Snapshot,
+    // Snapshot for tables small enough, walk otherwise
+    Auto
+};
 
-                    TableNode* p = &m_table.m_nodesPool[column.m_headNodeId];
-                    while (column.m_nodesCount != 0)
-                    {
-                        m_table.ejectRow(p->m_rowId);
-                        frame.m_rowIds.push_back(p->m_rowId);
-                        p = &m_table.m_nodesPool[p->m_downId];
-                    }
-                }
 
-                m_table.ejectColumn(node->m_columnId);
-                frame.m_columnId = node->m_columnId;
+// Row list is kept up to date during search unless built with ALGX_NO_ROW_LIST
+#ifdef ALGX_NO_ROW_LIST
+using SearchTable = SparseTable<false>;
+#else
+using SearchTable = SparseTable<true>;
+#endif
 
-                node = &m_table.m_nodesPool[node->m_rightId];
-            } while (node->m_id != pivotRow->m_headNodeId);
 
-            solution.push_back(pivotRow->m_id);
+class AlgorithmX
+{
+private:
+    struct BackupFrame
+    {
+        uint16_t m_columnId = INVALID_NODE_ID;
+        vector<uint16_t> m_rowIds;
+    };
 
-            bool done = solveIteration(solution);
-            if (done)
-                return true;
+    SearchTable m_table;
+    bool m_finished = false;
+    vector<uint16_t> m_finalSolution;
 
-            solution.pop_back();
+    // Rows fixed up front by select(), kept covered until reset()
+    vector<uint16_t> m_selectedRows;
+    vector<vector<BackupFrame>> m_selectedBackups;
+    vector<uint8_t> m_selectedColumns;
 
-            // Restore ejected
-            for (int i = backup.size() - 1; i >= 0; --i)
-            {
-                BackupFrame frame = backup[i];
+    // Columns starting from this one are secondary: covered at most once, not required
+    uint16_t m_primaryCount;
 
-                m_table.restoreColumn(frame.m_columnId);
-                for (int j = frame.m_rowIds.size() - 1; j >= 0; --j)
-                {
-                    m_table.restoreRow(frame.m_rowIds[j]);
-                }
-            }
+    uint32_t m_solutionsLimit = 1;
+    uint32_t m_solutionsCount = 0;
 
-            m_table.restoreRow(pivotRow->m_id);
+    // When set, rows of the pivot column are tried starting from a random one
+    mt19937* m_random = nullptr;
 
-            pivotRow = &m_table.m_rows.get(pivotRow->m_nextId);
-        } while (pivotRow->m_id != startingPivotRowId);
+    SearchStats m_stats;
 
-        return false;
-    }
-};
+    // Auto is resolved into the active strategy when a search starts
+    UndoStrategy m_undoStrategy = UndoStrategy::Auto;
+    UndoStrategy m_activeUndo = UndoStrategy::Walk;
+    Trail m_trail;
 
+    // Table state per search level, sized when a search starts and kept between searches
+    vector<char> m_snapshots;
 
-class SudokuProblem
-{
-private:
-    static const int PROBLEM_SIZE = 9;
+    // Undo data alive now and at most, solution path capacity at most
+    size_t m_undoBytes = 0;
+    size_t m_undoPeak = 0;
+    size_t m_solutionPeak = 0;
 
-    static const int ROW_COL_OFFSET = 0;
-    static const int ROW_NUM_OFFSET = PROBLEM_SIZE * PROBLEM_SIZE;
-    static const int COL_NUM_OFFSET = 2 * PROBLEM_SIZE * PROBLEM_SIZE;
-    static const int BOX_NUM_OFFSET = 3 * PROBLEM_SIZE * PROBLEM_SIZE;
-    static const int FILLED_NUM_OFFSET = 4 * PROBLEM_SIZE * PROBLEM_SIZE;
+#ifdef ALGX_MEMS
+    MemsCounters m_counters;
+#endif
 
-    int filledCellsCount = 0;
-    vector<vector<int>> problem;
+#ifdef ALGX_TRACE
+    SearchTrace m_trace;
+#endif
 
 public:
-    bool hasSolution = false;
-    vector<vector<int>> solvedProblem;
-
-    SudokuProblem(const string& data)
-        : problem(PROBLEM_SIZE, vector<int>(PROBLEM_SIZE, 0)), solvedProblem(PROBLEM_SIZE, vector<int>(PROBLEM_SIZE, 0))
+    AlgorithmX(uint16_t setsCount, uint16_t universeSize, uint16_t nodesCount)
+        : AlgorithmX(setsCount, universeSize, nodesCount, universeSize)
     {
-        for (int i = 0; i < PROBLEM_SIZE; ++i)
-        {
-            for (int j = 0; j < PROBLEM_SIZE; ++j)
-            {
-                problem[i][j] = data[i * PROBLEM_SIZE + j] == '.' ? 0 : data[i * PROBLEM_SIZE + j] - '0';
-                if (problem[i][j] != 0)
-                    ++filledCellsCount;
-            }
-        }
     }
 
-    void solve()
+    AlgorithmX(uint16_t setsCount, uint16_t universeSize, uint16_t nodesCount, uint16_t primaryCount)
+        : m_table(setsCount, universeSize, nodesCount)
+        , m_selectedColumns(universeSize, 0)
+        , m_primaryCount(primaryCount)
     {
-        uint16_t variants = PROBLEM_SIZE * PROBLEM_SIZE * PROBLEM_SIZE;
-        uint16_t universePower = 4 * PROBLEM_SIZE * PROBLEM_SIZE + filledCellsCount;
-        uint16_t nodesCount = 4 * PROBLEM_SIZE * PROBLEM_SIZE * PROBLEM_SIZE + filledCellsCount;
-        AlgorithmX algo(variants, universePower, nodesCount);
+        assert(primaryCount > 0 && primaryCount <= universeSize);
 
-        // Preparations
-        // Row-Column constraints first
-        for (int i = 0; i < PROBLEM_SIZE; ++i)
-            for (int j = 0; j < PROBLEM_SIZE; ++j)
-                for (int v = 0; v < PROBLEM_SIZE; ++v)
-                    algo.createNode(packRowID(i, j, v), ROW_COL_OFFSET + packColID(i, j));
+        // Secondary columns never take part in pivot selection and termination check
+        for (uint16_t id = primaryCount; id < universeSize; ++id)
+            m_table.m_columns.eject(id);
+    }
 
-        // Row-Number constraints
-        for (int i = 0; i < PROBLEM_SIZE; ++i)
-            for (int v = 0; v < PROBLEM_SIZE; ++v)
-                for (int j = 0; j < PROBLEM_SIZE; ++j)
-                    algo.createNode(packRowID(i, j, v), ROW_NUM_OFFSET + packColID(i, v));
+    inline void createNode(uint16_t setId, uint16_t id)
+    {
+        m_table.createNode(setId, id);
+    }
 
-        // Column-Number constraints
-        for (int j = 0; j < PROBLEM_SIZE; ++j)
-            for (int v = 0; v < PROBLEM_SIZE; ++v)
-                for (int i = 0; i < PROBLEM_SIZE; ++i)
-                    algo.createNode(packRowID(i, j, v), COL_NUM_OFFSET + packColID(j, v));
+    inline const vector<uint16_t>& getSolution() const { return m_finalSolution; }
 
-        // Box-Number constraints
-        for (int v = 0; v < PROBLEM_SIZE; ++v)
-            for (int i = 0; i < PROBLEM_SIZE; ++i)
-                for (int j = 0; j < PROBLEM_SIZE; ++j)
-                    algo.createNode(packRowID(i, j, v), BOX_NUM_OFFSET + packColID(getBoxID(i, j), v));
+    inline void setRandomEngine(mt19937* random) { m_random = random; }
 
-        // Filled numbers constraints
-        int counter = 0;
-        for (int i = 0; i < PROBLEM_SIZE; ++i)
-            for (int j = 0; j < PROBLEM_SIZE; ++j)
-            {
-                if (problem[i][j] != 0)
-                    algo.createNode(packRowID(i, j, problem[i][j] - 1), FILLED_NUM_OFFSET + counter++);
-            }
+    /*
+    * Copying the whole state per level pays off when a cover relinks much of it:
+    * on dense random matrices (--undo-bench) snapshots win even at 100 KB, while on
+    * the classic sudoku matrix (about 37.6 KB, short columns) they are 2-2.5 times
+    * slower. The limit stays well below the sudoku state
+    */
+    static const size_t SNAPSHOT_LIMIT_BYTES = 16 * 1024;
 
-        
+    // Bytes one snapshot copies, what Auto compares against the limit
+    inline size_t stateBytes() const { return m_table.stateBytes(); }
 
-        bool success = algo.solve();
+    // Applies to search only, rows fixed by select() always use backup frames
+    inline void setUndoStrategy(UndoStrategy strategy) { m_undoStrategy = strategy; }
 
-        // cout << "Solution was successfull: " << success << endl;
+    // Between problems only, with no rows selected
+    inline void renumberNodes(NodeOrder order)
+    {
+        assert(m_selectedRows.empty());
+        m_table.renumberNodes(order);
+    }
 
-        // Decoding result
-        const vector<uint16_t> solution = algo.getSolution();
-        hasSolution = success && solution.size() == PROBLEM_SIZE * PROBLEM_SIZE;
-        if (hasSolution)
-        {
-            for (int i = 0; i < solution.size(); ++i)
-            {
-                int t = solution[i];
-                int x = t / (PROBLEM_SIZE * PROBLEM_SIZE);
-                int y = (t - x * (PROBLEM_SIZE * PROBLEM_SIZE)) / PROBLEM_SIZE;
-                int v = t % PROBLEM_SIZE + 1;
+    // Statistics of the last search, kept until the next one starts
+    inline const SearchStats& getStats() const { return m_stats; }
 
-                solvedProblem[x][y] = v;
+    MemoryFootprint memoryFootprint() const
+    {
+        MemoryFootprint footprint;
+        footprint.m_objects = sizeof(*this);
+        m_table.addFootprint(footprint);
+        footprint.m_undoPeak = m_undoPeak + m_selectedBackups.capacity() * sizeof(vector<BackupFrame>) + m_trail.capacityBytes() + m_snapshots.capacity();
+        footprint.m_buffers = (m_finalSolution.capacity() + m_selectedRows.capacity() + m_solutionPeak) * sizeof(uint16_t) +
+            m_selectedColumns.capacity() + (m_stats.m_levelVisits.capacity() + m_stats.m_levelBranches.capacity()) * sizeof(uint32_t);
+        return footprint;
+    }
+
+#ifdef ALGX_MEMS
+    // Costs of the last search, select() and reset() are not included
+    inline const MemsCounters& getCounters() const { return m_counters; }
+#endif
+
+#ifdef ALGX_TRACE
+    inline const SearchTrace& getTrace() const { return m_trace; }
+#endif
+
+    /*
+    * Forces set into the solution before search. Returns false if it
+    * intersects one of already selected sets, table is left untouched then
+    */
+    bool select(uint16_t setId)
+    {
+        assert(!m_finished);
+
+        RowHeader& row = m_table.m_rows.get(setId);
+        if (row.isEmpty())
+            return false;
+
+        uint16_t nodeId = row.m_headNodeId;
+        do
+        {
+            if (m_selectedColumns[m_table.m_nodesPool[nodeId].m_columnId])
+                return false;
+            nodeId = m_table.m_nodesPool[nodeId].m_rightId;
+        } while (nodeId != row.m_headNodeId);
+
+        do
+        {
+            m_selectedColumns[m_table.m_nodesPool[nodeId].m_columnId] = 1;
+            nodeId = m_table.m_nodesPool[nodeId].m_rightId;
+        } while (nodeId != row.m_headNodeId);
+
+        m_selectedBackups.emplace_back();
+        m_undoBytes += coverRow(setId, m_selectedBackups.back());
+        m_undoPeak = max(m_undoPeak, m_undoBytes);
+        m_selectedRows.push_back(setId);
+
+        return true;
+    }
+
+    /*
+    * Brings table back to the freshly built state, so the same instance
+    * can be reused for another problem over the same universe
+    */
+    void reset()
+    {
+        for (int i = static_cast<int>(m_selectedRows.size()) - 1; i >= 0; --i)
+        {
+            uncoverRow(m_selectedRows[i], m_selectedBackups[i]);
+        }
+
+        for (uint16_t rowId : m_selectedRows)
+        {
+            uint16_t nodeId = m_table.m_rows.get(rowId).m_headNodeId;
+            do
+            {
+                m_selectedColumns[m_table.m_nodesPool[nodeId].m_columnId] = 0;
+                nodeId = m_table.m_nodesPool[nodeId].m_rightId;
+            } while (nodeId != m_table.m_rows.get(rowId).m_headNodeId);
+        }
+
+        m_selectedRows.clear();
+        m_selectedBackups.clear();
+        m_undoBytes = 0;
+        m_finalSolution.clear();
+        m_finished = false;
+    }
+
+    bool solve()
+    {
+        return countSolutions(1) != 0;
+    }
+
+    /*
+    * Counts solutions, stopping as soon as limit is reached.
+    * The first solution found is available via getSolution()
+    */
+    uint32_t countSolutions(uint32_t limit)
+    {
+        assert(!m_finished && limit > 0);
+
+        m_solutionsLimit = limit;
+        m_solutionsCount = 0;
+        m_stats.clear();
+
+        m_activeUndo = m_undoStrategy;
+        if (m_activeUndo == UndoStrategy::Auto)
+            m_activeUndo = m_table.stateBytes() <= SNAPSHOT_LIMIT_BYTES ? UndoStrategy::Snapshot : UndoStrategy::Walk;
+
+        // Every level covers at least one row and one column, which bounds the depth
+        if (m_activeUndo == UndoStrategy::Snapshot)
+        {
+            const size_t levels = min(m_table.m_rows.length(), m_table.m_columns.length());
+            if (m_snapshots.size() < levels * m_table.stateBytes())
+                m_snapshots.resize(levels * m_table.stateBytes());
+        }
+#ifdef ALGX_MEMS
+        m_table.m_counters.clear();
+#endif
+#ifdef ALGX_TRACE
+        m_trace.clear();
+#endif
+
+        vector<uint16_t> solution(m_selectedRows);
+        solveIteration(solution);
+        m_solutionPeak = max(m_solutionPeak, solution.capacity());
+
+#ifdef ALGX_MEMS
+        m_counters = m_table.m_counters;
+#endif
+
+        // Prevent double execution
+        m_finished = true;
+
+        return m_solutionsCount;
+    }
+
+private:
+    inline ColumnHeader* findPivotColumn()
+    {
+        return m_table.findShortestColumn();
+    }
+
+    /*
+    * Ejects row together with its columns and all rows intersecting them.
+    * Returns bytes taken by the backup
+    */
+    size_t coverRow(uint16_t rowId, vector<BackupFrame>& backup)
+    {
+        const RowHeader& row = m_table.m_rows.get(rowId);
+        m_table.ejectRow(rowId);
+        backup.reserve(row.m_nodesCount);
+        size_t bytes = backup.capacity() * sizeof(BackupFrame);
+
+        uint16_t nodeId = row.m_headNodeId;
+        do
+        {
+            const TableNode* node = &m_table.m_nodesPool[nodeId];
+            backup.emplace_back();
+            BackupFrame& frame = backup.back();
+            auto& column = m_table.m_columns.get(node->m_columnId);
+            ALGX_COUNT_MEMS(m_table.m_counters, 2, 0);
+            if (column.m_nodesCount > 0)
+            {
+                frame.m_rowIds.reserve(column.m_nodesCount);
+                bytes += frame.m_rowIds.capacity() * sizeof(uint16_t);
+
+                uint16_t p = column.m_headNodeId;
+                while (column.m_nodesCount != 0)
+                {
+                    ALGX_COUNT_MEMS(m_table.m_counters, 1, 0);
+                    const uint16_t coveredRowId = m_table.rowOf(p);
+                    m_table.ejectRow(coveredRowId);
+                    frame.m_rowIds.push_back(coveredRowId);
+                    p = m_table.m_nodesPool[p].m_downId;
+                }
+            }
+
+            if (node->m_columnId < m_primaryCount)
+            {
+                m_table.ejectColumn(node->m_columnId);
+                frame.m_columnId = node->m_columnId;
+            }
+
+            nodeId = node->m_rightId;
+        } while (nodeId != row.m_headNodeId);
+
+        return bytes;
+    }
+
+    /*
+    * Same as coverRow, but without backup frames: undo is up to the writer,
+    * the trail logs all writes, for snapshots they go directly
+    */
+    template<typename Writer>
+    void coverRowWith(uint16_t rowId, Writer&& writer)
+    {
+        const RowHeader& row = m_table.m_rows.get(rowId);
+        m_table.ejectRow(rowId, writer);
+
+        uint16_t nodeId = row.m_headNodeId;
+        do
+        {
+            const TableNode* node = &m_table.m_nodesPool[nodeId];
+            auto& column = m_table.m_columns.get(node->m_columnId);
+            ALGX_COUNT_MEMS(m_table.m_counters, 2, 0);
+
+            uint16_t p = column.m_headNodeId;
+            while (column.m_nodesCount != 0)
+            {
+                ALGX_COUNT_MEMS(m_table.m_counters, 1, 0);
+                m_table.ejectRow(m_table.rowOf(p), writer);
+                p = m_table.m_nodesPool[p].m_downId;
+            }
+
+            if (node->m_columnId < m_primaryCount)
+                m_table.ejectColumn(node->m_columnId, writer);
+
+            nodeId = node->m_rightId;
+        } while (nodeId != row.m_headNodeId);
+    }
+
+    void uncoverRow(uint16_t rowId, const vector<BackupFrame>& backup)
+    {
+        for (int i = static_cast<int>(backup.size()) - 1; i >= 0; --i)
+        {
+            const BackupFrame& frame = backup[i];
+
+            if (frame.m_columnId != INVALID_NODE_ID)
+                m_table.restoreColumn(frame.m_columnId);
+            for (int j = static_cast<int>(frame.m_rowIds.size()) - 1; j >= 0; --j)
+            {
+                m_table.restoreRow(frame.m_rowIds[j]);
+            }
+        }
+
+        m_table.restoreRow(rowId);
+    }
+
+    bool solveIteration(vector<uint16_t>& solution)
+    {
+        if (m_table.m_columns.length() == 0)
+        {
+            // We have solution
+
+            if (m_solutionsCount++ == 0)
+                m_finalSolution = solution;
+
+#ifdef ALGX_TRACE
+            m_trace.push({ static_cast<uint16_t>(solution.size() - m_selectedRows.size()), INVALID_NODE_ID, 0, INVALID_NODE_ID, TraceOutcome::Solution });
+#endif
+
+#ifdef ALGX_MEMS
+            const size_t level = solution.size() - m_selectedRows.size();
+            auto& levelSolutions = m_table.m_counters.m_levelSolutions;
+            if (level >= levelSolutions.size())
+                levelSolutions.resize(level + 1, 0);
+            ++levelSolutions[level];
+#endif
+
+            return m_solutionsCount >= m_solutionsLimit;
+        }
+
+        const uint32_t depth = static_cast<uint32_t>(solution.size() - m_selectedRows.size());
+
+        ColumnHeader* pivotColumn = findPivotColumn();
+        if (pivotColumn->m_nodesCount == 0)
+        {
+#ifdef ALGX_TRACE
+            m_trace.push({ static_cast<uint16_t>(depth), m_table.m_columns.idOf(*pivotColumn), 0, INVALID_NODE_ID, TraceOutcome::DeadEnd });
+#endif
+            return false;
+        }
+
+        if (depth >= m_stats.m_levelVisits.size())
+        {
+            m_stats.m_levelVisits.resize(depth + 1, 0);
+            m_stats.m_levelBranches.resize(depth + 1, 0);
+        }
+
+        ++m_stats.m_levelVisits[depth];
+        m_stats.m_levelBranches[depth] += pivotColumn->m_nodesCount;
+        m_stats.m_maxDepth = max(m_stats.m_maxDepth, depth + 1);
+        if (pivotColumn->m_nodesCount == 1)
+            ++m_stats.m_forcedSteps;
+
+        // State before any row of this level is covered, shared by all of them
+        const size_t snapshotOffset = depth * m_table.stateBytes();
+        if (m_activeUndo == UndoStrategy::Snapshot)
+        {
+            m_table.saveState(&m_snapshots[snapshotOffset]);
+            // One mem per copied word
+            ALGX_COUNT_MEMS(m_table.m_counters, m_table.stateBytes() / sizeof(uint16_t), 0);
+        }
+
+        // Only rows of the pivot column are tried, it has to be covered by one of them
+        uint16_t startingNodeId = pivotColumn->m_headNodeId;
+        if (m_random != nullptr)
+        {
+            for (uint32_t k = (*m_random)() % pivotColumn->m_nodesCount; k > 0; --k)
+                startingNodeId = m_table.m_nodesPool[startingNodeId].m_downId;
+        }
+
+        uint16_t nodeId = startingNodeId;
+        do
+        {
+            const uint16_t pivotRowId = m_table.rowOf(nodeId);
+
+            ++m_stats.m_nodesVisited;
+
+#ifdef ALGX_TRACE
+            const uint64_t traceIndex = m_trace.push({ static_cast<uint16_t>(depth), m_table.m_columns.idOf(*pivotColumn), pivotColumn->m_nodesCount, pivotRowId, TraceOutcome::Backtrack });
+#endif
+
+            vector<BackupFrame> backup;
+#ifdef ALGX_MEMS
+            const uint64_t updatesBefore = m_table.m_counters.m_linkUpdates;
+#endif
+            // Trail keeps its own capacity, only backup frames are tracked here
+            const size_t checkpoint = m_trail.checkpoint();
+            size_t undoBytes = 0;
+            if (m_activeUndo == UndoStrategy::Trail)
+            {
+                coverRowWith(pivotRowId, m_trail);
+            }
+            else if (m_activeUndo == UndoStrategy::Snapshot)
+            {
+                coverRowWith(pivotRowId, DirectWrite());
+            }
+            else
+            {
+                undoBytes = coverRow(pivotRowId, backup);
+                m_undoBytes += undoBytes;
+                m_undoPeak = max(m_undoPeak, m_undoBytes);
+            }
+#ifdef ALGX_MEMS
+            auto& levelUpdates = m_table.m_counters.m_levelUpdates;
+            if (depth >= levelUpdates.size())
+                levelUpdates.resize(depth + 1, 0);
+            levelUpdates[depth] += m_table.m_counters.m_linkUpdates - updatesBefore;
+#endif
+
+            solution.push_back(pivotRowId);
+
+            bool done = solveIteration(solution);
+
+            solution.pop_back();
+
+            // Table is always unwound, so the instance stays reusable after success
+            if (m_activeUndo == UndoStrategy::Trail)
+            {
+                // Every entry is read and written back once
+                ALGX_COUNT_MEMS(m_table.m_counters, m_trail.checkpoint() - checkpoint, m_trail.checkpoint() - checkpoint);
+                m_trail.rollback(checkpoint);
+            }
+            else if (m_activeUndo == UndoStrategy::Snapshot)
+            {
+                // Every word is written back, touched or not
+                ALGX_COUNT_MEMS(m_table.m_counters, m_table.stateBytes() / sizeof(uint16_t), m_table.stateBytes() / sizeof(uint16_t));
+                m_table.loadState(&m_snapshots[snapshotOffset]);
+            }
+            else
+            {
+                uncoverRow(pivotRowId, backup);
+            }
+            m_undoBytes -= undoBytes;
+
+            if (done)
+            {
+#ifdef ALGX_TRACE
+                m_trace.setOutcome(traceIndex, TraceOutcome::Done);
+#endif
+                return true;
+            }
+
+            ++m_stats.m_backtracks;
+
+            nodeId = m_table.m_nodesPool[nodeId].m_downId;
+        } while (nodeId != startingNodeId);
+
+        return false;
+    }
+};
+
+
+/*
+* Cheap timestamps for per-puzzle timing. Uses the time stamp counter where
+* available, ticks are converted to nanoseconds by calibrating against
+* steady_clock over the whole measured interval
+*/
+class LatencyClock
+{
+private:
+    uint64_t m_startTicks;
+    chrono::steady_clock::time_point m_startTime;
+
+public:
+    LatencyClock()
+        : m_startTicks(now())
+        , m_startTime(chrono::steady_clock::now())
+    {
+    }
+
+    static inline uint64_t now()
+    {
+#ifdef ALGX_HAS_RDTSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    // Nanoseconds per tick, measured from construction till now
+    double nsPerTick() const
+    {
+        uint64_t ticks = now() - m_startTicks;
+        double ns = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - m_startTime).count());
+        return ticks > 0 ? ns / ticks : 1.0;
+    }
+};
+
+
+// Build is the one-time matrix construction, select fixes givens of a puzzle and undoes them after
+enum class Phase : uint8_t
+{
+    Parse,
+    Build,
+    Select,
+    Search,
+    Decode,
+    Count
+};
+
+
+#ifdef ALGX_PHASE_TIMERS
+/*
+* Time spent per solver phase, summed over all solves and threads of the run.
+* Compiled in only with ALGX_PHASE_TIMERS, otherwise ALGX_PHASE expands to nothing
+*/
+atomic<uint64_t> g_phaseTicks[static_cast<int>(Phase::Count)];
+
+
+class PhaseTimer
+{
+private:
+    Phase m_phase;
+    uint64_t m_start;
+
+public:
+    explicit PhaseTimer(Phase phase)
+        : m_phase(phase)
+        , m_start(LatencyClock::now())
+    {
+    }
+
+    ~PhaseTimer()
+    {
+        g_phaseTicks[static_cast<int>(m_phase)].fetch_add(LatencyClock::now() - m_start, memory_order_relaxed);
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
+
+
+void printPhaseReport(ostream& stream, double nsPerTick)
+{
+    static const char* const NAMES[] = { "parse", "build", "select", "search", "decode" };
+
+    uint64_t total = 0;
+    for (const auto& ticks : g_phaseTicks)
+        total += ticks.load(memory_order_relaxed);
+
+    stream << "Phases:";
+    for (int phase = 0; phase < static_cast<int>(Phase::Count); ++phase)
+    {
+        uint64_t ticks = g_phaseTicks[phase].load(memory_order_relaxed);
+        stream << " " << NAMES[phase] << "=" << ticks * nsPerTick / 1e6 << "ms (" << (total > 0 ? 100.0 * ticks / total : 0) << "%)";
+    }
+    stream << endl;
+}
+
+#define ALGX_PHASE_CONCAT_IMPL(a, b) a##b
+#define ALGX_PHASE_CONCAT(a, b) ALGX_PHASE_CONCAT_IMPL(a, b)
+#define ALGX_PHASE(phase) PhaseTimer ALGX_PHASE_CONCAT(phaseTimer, __LINE__)(phase)
+#else
+#define ALGX_PHASE(phase)
+#endif
+
+
+#ifdef ALGX_ALLOC_STATS
+/*
+* Heap usage of the current thread, counted by the replaced global allocation
+* functions below. Compiled in only with ALGX_ALLOC_STATS
+*/
+struct AllocationCounts
+{
+    uint64_t m_allocations = 0;
+    uint64_t m_frees = 0;
+    uint64_t m_bytes = 0;
+};
+
+thread_local AllocationCounts t_allocations;
+
+
+/*
+* Like the standard ones, failed attempts give the new_handler a chance to free
+* memory before bad_alloc, nothrow forms return null instead of throwing
+*/
+void* operator new(size_t size)
+{
+    for (;;)
+    {
+        if (void* p = malloc(size > 0 ? size : 1))
+        {
+            ++t_allocations.m_allocations;
+            t_allocations.m_bytes += size;
+            return p;
+        }
+
+        new_handler handler = get_new_handler();
+        if (handler == nullptr)
+            throw bad_alloc();
+        handler();
+    }
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    try
+    {
+        return operator new(size);
+    }
+    catch (const bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+// GCC takes free() inside the replaced delete for a mismatch with operator new
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept
+{
+    if (p != nullptr)
+    {
+        ++t_allocations.m_frees;
+        free(p);
+    }
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, const nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, const nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+// Over-aligned types (alignas above the default) come through these, blocks go back to a matching free
+void* operator new(size_t size, align_val_t alignment)
+{
+    const size_t align = static_cast<size_t>(alignment);
+    for (;;)
+    {
+#ifdef _WIN32
+        void* p = _aligned_malloc(size > 0 ? size : 1, align);
+#else
+        // aligned_alloc wants a multiple of the alignment
+        void* p = aligned_alloc(align, size > 0 ? (size + align - 1) / align * align : align);
+#endif
+        if (p != nullptr)
+        {
+            ++t_allocations.m_allocations;
+            t_allocations.m_bytes += size;
+            return p;
+        }
+
+        new_handler handler = get_new_handler();
+        if (handler == nullptr)
+            throw bad_alloc();
+        handler();
+    }
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+    try
+    {
+        return operator new(size, alignment);
+    }
+    catch (const bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t& tag) noexcept
+{
+    return operator new(size, alignment, tag);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p, align_val_t) noexcept
+{
+    if (p != nullptr)
+    {
+        ++t_allocations.m_frees;
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete[](void* p, align_val_t alignment) noexcept
+{
+    operator delete(p, alignment);
+}
+
+void operator delete(void* p, size_t, align_val_t alignment) noexcept
+{
+    operator delete(p, alignment);
+}
+
+void operator delete[](void* p, size_t, align_val_t alignment) noexcept
+{
+    operator delete(p, alignment);
+}
+
+void operator delete(void* p, align_val_t alignment, const nothrow_t&) noexcept
+{
+    operator delete(p, alignment);
+}
+
+void operator delete[](void* p, align_val_t alignment, const nothrow_t&) noexcept
+{
+    operator delete(p, alignment);
+}
+#endif
+
+
+enum class Status : uint8_t
+{
+    Solved,
+    NoSolution,
+    InvalidInput
+};
+
+
+const char* statusName(Status status)
+{
+    switch (status)
+    {
+    case Status::Solved:
+        return "solved";
+    case Status::NoSolution:
+        return "unsolvable";
+    default:
+        return "invalid";
+    }
+}
+
+
+/*
+* Converts 81 characters into cell values, 0 for blanks. Givens are '1'-'9',
+* blanks are '0', '.' or '_'. Returns false on any other character. Groups
+* depend on the variant, so repeated givens are left to the solver
+*/
+bool parsePuzzle(const char* text, uint8_t* cells)
+{
+    const int CELLS_COUNT = 81;
+    const int SIMD_CELLS = CELLS_COUNT / 16 * 16;
+
+    int cell = 0;
+    bool valid = true;
+
+#ifdef ALGX_PARSE_SSE2
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i one = _mm_set1_epi8('1');
+    const __m128i eight = _mm_set1_epi8(8);
+    const __m128i dot = _mm_set1_epi8('.');
+    const __m128i underscore = _mm_set1_epi8('_');
+
+    int validMask = 0xFFFF;
+    for (; cell < SIMD_CELLS; cell += 16)
+    {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + cell));
+
+        // Unsigned c - '1' <= 8 holds for givens only
+        __m128i offset = _mm_sub_epi8(chars, one);
+        __m128i given = _mm_cmpeq_epi8(_mm_min_epu8(offset, eight), offset);
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(chars, zero), _mm_or_si128(_mm_cmpeq_epi8(chars, dot), _mm_cmpeq_epi8(chars, underscore)));
+
+        validMask &= _mm_movemask_epi8(_mm_or_si128(given, blank));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(cells + cell), _mm_and_si128(given, _mm_sub_epi8(chars, zero)));
+    }
+    valid = validMask == 0xFFFF;
+#else
+    (void)SIMD_CELLS;
+#endif
+
+    for (; cell < CELLS_COUNT; ++cell)
+    {
+        char c = text[cell];
+        bool given = c >= '1' && c <= '9';
+        valid &= given || c == '0' || c == '.' || c == '_';
+        cells[cell] = given ? static_cast<uint8_t>(c - '0') : 0;
+    }
+
+    return valid;
+}
+
+
+enum class Difficulty : uint8_t
+{
+    Easy,
+    Medium,
+    Hard,
+    Expert
+};
+
+
+struct DifficultyRating
+{
+    double m_score;
+    Difficulty m_grade;
+};
+
+
+/*
+* Grades puzzle by the search it took. Puzzles solvable by singles never
+* branch and score 1, beyond that score grows with logarithm of guesses
+* (alternatives met at branching points) and, twice as fast, of rows
+* which turned out wrong
+*/
+DifficultyRating rateDifficulty(const SearchStats& stats)
+{
+    DifficultyRating rating;
+    rating.m_score = 1.0 + log2(1.0 + stats.guesses()) + 2.0 * log2(1.0 + stats.m_backtracks);
+
+    if (stats.guesses() == 0)
+        rating.m_grade = Difficulty::Easy;
+    else if (rating.m_score < 5.0)
+        rating.m_grade = Difficulty::Medium;
+    else if (rating.m_score < 10.0)
+        rating.m_grade = Difficulty::Hard;
+    else
+        rating.m_grade = Difficulty::Expert;
+
+    return rating;
+}
+
+
+const char* difficultyName(Difficulty difficulty)
+{
+    switch (difficulty)
+    {
+    case Difficulty::Easy:
+        return "easy";
+    case Difficulty::Medium:
+        return "medium";
+    case Difficulty::Hard:
+        return "hard";
+    default:
+        return "expert";
+    }
+}
+
+
+/*
+* Collects exact cover matrix of a 9x9 sudoku variant. Rows 0..728 are
+* "cell holds value" choices (cell * 9 + value), constraints may add their
+* own rows after them. Secondary columns get their final ids after all
+* primary ones once the matrix is complete
+*/
+class SudokuMatrixBuilder
+{
+public:
+    static const int PROBLEM_SIZE = 9;
+    static const int CELLS_COUNT = PROBLEM_SIZE * PROBLEM_SIZE;
+    static const uint16_t CELL_ROWS_COUNT = CELLS_COUNT * PROBLEM_SIZE;
+
+private:
+    static const uint16_t SECONDARY_FLAG = 0x8000;
+
+    uint16_t m_rowsCount = CELL_ROWS_COUNT;
+    uint16_t m_primaryCount = 0;
+    uint16_t m_secondaryCount = 0;
+    vector<pair<uint16_t, uint16_t>> m_nodes;
+
+public:
+    static inline uint16_t cellRow(int cell, int v) { return cell * PROBLEM_SIZE + v; }
+
+    // Returns id of the first of count new columns which must be covered exactly once
+    uint16_t addPrimaryColumns(int count)
+    {
+        uint16_t first = m_primaryCount;
+        m_primaryCount += count;
+        assert(m_primaryCount < SECONDARY_FLAG);
+        return first;
+    }
+
+    // Returns id of the first of count new columns which may be covered at most once
+    uint16_t addSecondaryColumns(int count)
+    {
+        uint16_t first = m_secondaryCount;
+        m_secondaryCount += count;
+        assert(m_secondaryCount < SECONDARY_FLAG);
+        return SECONDARY_FLAG | first;
+    }
+
+    // Returns id of the first of count new rows besides cell rows
+    uint16_t addRows(int count)
+    {
+        uint16_t first = m_rowsCount;
+        assert(m_rowsCount + count < INVALID_NODE_ID);
+        m_rowsCount += count;
+        return first;
+    }
+
+    inline void addNode(uint16_t rowId, uint16_t columnId)
+    {
+        m_nodes.emplace_back(rowId, columnId);
+    }
+
+    inline uint16_t rowsCount() const { return m_rowsCount; }
+    inline uint16_t primaryColumnsCount() const { return m_primaryCount; }
+    inline uint16_t columnsCount() const { return m_primaryCount + m_secondaryCount; }
+
+    inline uint16_t nodesCount() const
+    {
+        assert(m_nodes.size() < INVALID_NODE_ID);
+        return static_cast<uint16_t>(m_nodes.size());
+    }
+
+    void populate(AlgorithmX& algo) const
+    {
+        vector<pair<uint16_t, uint16_t>> nodes;
+        nodes.reserve(m_nodes.size());
+        for (const auto& node : m_nodes)
+        {
+            uint16_t columnId = node.second & SECONDARY_FLAG ? m_primaryCount + (node.second & ~SECONDARY_FLAG) : node.second;
+            nodes.emplace_back(node.first, columnId);
+        }
+
+        // Sorted order turns every insertion into an append
+        sort(nodes.begin(), nodes.end());
+        for (const auto& node : nodes)
+            algo.createNode(node.first, node.second);
+    }
+};
+
+
+class SudokuConstraint
+{
+public:
+    virtual ~SudokuConstraint() = default;
+
+    virtual void build(SudokuMatrixBuilder& builder) const = 0;
+
+    // Groups of cells whose values must all differ, used to reject repeated givens early
+    virtual void addGroups(vector<vector<uint8_t>>& groups) const
+    {
+        (void)groups;
+    }
+};
+
+using SudokuConstraints = vector<unique_ptr<SudokuConstraint>>;
+
+
+// Every cell holds exactly one value
+class CellsConstraint : public SudokuConstraint
+{
+public:
+    void build(SudokuMatrixBuilder& builder) const override
+    {
+        uint16_t first = builder.addPrimaryColumns(SudokuMatrixBuilder::CELLS_COUNT);
+        for (int cell = 0; cell < SudokuMatrixBuilder::CELLS_COUNT; ++cell)
+            for (int v = 0; v < SudokuMatrixBuilder::PROBLEM_SIZE; ++v)
+                builder.addNode(SudokuMatrixBuilder::cellRow(cell, v), first + cell);
+    }
+};
+
+
+/*
+* Every value appears once within each group of cells. Groups of 9 cells
+* must contain all values, smaller ones only forbid repeats
+*/
+class GroupsConstraint : public SudokuConstraint
+{
+private:
+    vector<vector<uint8_t>> m_groups;
+
+public:
+    explicit GroupsConstraint(vector<vector<uint8_t>> groups)
+        : m_groups(move(groups))
+    {
+    }
+
+    void build(SudokuMatrixBuilder& builder) const override
+    {
+        const int size = SudokuMatrixBuilder::PROBLEM_SIZE;
+
+        for (const auto& group : m_groups)
+        {
+            assert(group.size() <= static_cast<size_t>(size));
+
+            uint16_t first = group.size() == static_cast<size_t>(size) ? builder.addPrimaryColumns(size) : builder.addSecondaryColumns(size);
+            for (uint8_t cell : group)
+                for (int v = 0; v < size; ++v)
+                    builder.addNode(SudokuMatrixBuilder::cellRow(cell, v), first + v);
+        }
+    }
+
+    void addGroups(vector<vector<uint8_t>>& groups) const override
+    {
+        groups.insert(groups.end(), m_groups.begin(), m_groups.end());
+    }
+
+    static unique_ptr<SudokuConstraint> rows()
+    {
+        return fromRegions([](int i, int) { return i; });
+    }
+
+    static unique_ptr<SudokuConstraint> columns()
+    {
+        return fromRegions([](int, int j) { return j; });
+    }
+
+    static unique_ptr<SudokuConstraint> boxes()
+    {
+        return fromRegions([](int i, int j) { return (i / 3) * 3 + j / 3; });
+    }
+
+    // X-sudoku: both main diagonals hold all values
+    static unique_ptr<SudokuConstraint> diagonals()
+    {
+        const int size = SudokuMatrixBuilder::PROBLEM_SIZE;
+
+        vector<vector<uint8_t>> groups(2);
+        for (int k = 0; k < size; ++k)
+        {
+            groups[0].push_back(k * size + k);
+            groups[1].push_back(k * size + size - 1 - k);
+        }
+
+        return make_unique<GroupsConstraint>(move(groups));
+    }
+
+    // Jigsaw regions given as 81 characters, equal characters belong to the same region
+    static unique_ptr<SudokuConstraint> jigsaw(const string& layout)
+    {
+        assert(layout.size() == static_cast<size_t>(SudokuMatrixBuilder::CELLS_COUNT));
+
+        vector<char> labels;
+        for (char c : layout)
+            if (find(labels.begin(), labels.end(), c) == labels.end())
+                labels.push_back(c);
+
+        assert(labels.size() == static_cast<size_t>(SudokuMatrixBuilder::PROBLEM_SIZE));
+
+        return fromRegions([&](int i, int j) {
+            char c = layout[i * SudokuMatrixBuilder::PROBLEM_SIZE + j];
+            return static_cast<int>(find(labels.begin(), labels.end(), c) - labels.begin());
+        });
+    }
+
+private:
+    template<typename RegionFn>
+    static unique_ptr<SudokuConstraint> fromRegions(RegionFn region)
+    {
+        const int size = SudokuMatrixBuilder::PROBLEM_SIZE;
+
+        vector<vector<uint8_t>> groups(size);
+        for (int i = 0; i < size; ++i)
+            for (int j = 0; j < size; ++j)
+                groups[region(i, j)].push_back(i * size + j);
+
+        return make_unique<GroupsConstraint>(move(groups));
+    }
+};
+
+
+// Cells a chess knight's move apart never hold the same value
+class AntiKnightConstraint : public SudokuConstraint
+{
+public:
+    void build(SudokuMatrixBuilder& builder) const override
+    {
+        const int size = SudokuMatrixBuilder::PROBLEM_SIZE;
+
+        forEachPair([&](uint8_t cell, uint8_t other) {
+            uint16_t first = builder.addSecondaryColumns(size);
+            for (int v = 0; v < size; ++v)
+            {
+                builder.addNode(SudokuMatrixBuilder::cellRow(cell, v), first + v);
+                builder.addNode(SudokuMatrixBuilder::cellRow(other, v), first + v);
+            }
+        });
+    }
+
+    void addGroups(vector<vector<uint8_t>>& groups) const override
+    {
+        forEachPair([&](uint8_t cell, uint8_t other) { groups.push_back({ cell, other }); });
+    }
+
+private:
+    template<typename PairFn>
+    static void forEachPair(PairFn fn)
+    {
+        const int size = SudokuMatrixBuilder::PROBLEM_SIZE;
+        static const int MOVES[4][2] = { { 1, 2 }, { 2, 1 }, { 1, -2 }, { 2, -1 } };
+
+        // Only "forward" moves, so every pair is visited once
+        for (int i = 0; i < size; ++i)
+            for (int j = 0; j < size; ++j)
+                for (const auto& move : MOVES)
+                {
+                    int oi = i + move[0], oj = j + move[1];
+                    if (oi >= size || oj < 0 || oj >= size)
+                        continue;
+
+                    fn(static_cast<uint8_t>(i * size + j), static_cast<uint8_t>(oi * size + oj));
+                }
+    }
+};
+
+
+/*
+* Killer cages: values within a cage are distinct and add up to its sum.
+* Every cage gets one extra row per allowed combination of values, choosing
+* it blocks all cell rows of the cage with values outside the combination
+*/
+class KillerConstraint : public SudokuConstraint
+{
+public:
+    struct Cage
+    {
+        vector<uint8_t> m_cells;
+        int m_sum;
+    };
+
+private:
+    vector<Cage> m_cages;
+
+public:
+    explicit KillerConstraint(vector<Cage> cages)
+        : m_cages(move(cages))
+    {
+    }
+
+    void build(SudokuMatrixBuilder& builder) const override
+    {
+        const int size = SudokuMatrixBuilder::PROBLEM_SIZE;
+
+        for (const Cage& cage : m_cages)
+        {
+            const int cellsCount = static_cast<int>(cage.m_cells.size());
+            assert(cellsCount > 0 && cellsCount <= size);
+
+            vector<uint16_t> combinations;
+            for (uint16_t mask = 0; mask < (1 << size); ++mask)
+            {
+                int count = 0, sum = 0;
+                for (int v = 0; v < size; ++v)
+                    if (mask & (1 << v))
+                    {
+                        ++count;
+                        sum += v + 1;
+                    }
+
+                if (count == cellsCount && sum == cage.m_sum)
+                    combinations.push_back(mask);
+            }
+
+            // No combinations leaves the primary column empty, so the puzzle has no solution
+            uint16_t cageColumn = builder.addPrimaryColumns(1);
+            uint16_t distinctColumns = builder.addSecondaryColumns(size);
+            uint16_t forbiddenColumns = builder.addSecondaryColumns(cellsCount * size);
+
+            for (int k = 0; k < cellsCount; ++k)
+                for (int v = 0; v < size; ++v)
+                {
+                    uint16_t rowId = SudokuMatrixBuilder::cellRow(cage.m_cells[k], v);
+                    builder.addNode(rowId, distinctColumns + v);
+                    builder.addNode(rowId, forbiddenColumns + k * size + v);
+                }
+
+            uint16_t firstRow = builder.addRows(static_cast<int>(combinations.size()));
+            for (size_t c = 0; c < combinations.size(); ++c)
+            {
+                uint16_t rowId = static_cast<uint16_t>(firstRow + c);
+                builder.addNode(rowId, cageColumn);
+
+                for (int k = 0; k < cellsCount; ++k)
+                    for (int v = 0; v < size; ++v)
+                        if (!(combinations[c] & (1 << v)))
+                            builder.addNode(rowId, forbiddenColumns + k * size + v);
+            }
+        }
+    }
+
+    void addGroups(vector<vector<uint8_t>>& groups) const override
+    {
+        for (const Cage& cage : m_cages)
+            groups.push_back(cage.m_cells);
+    }
+};
+
+
+SudokuConstraints classicConstraints()
+{
+    SudokuConstraints constraints;
+    constraints.push_back(make_unique<CellsConstraint>());
+    constraints.push_back(GroupsConstraint::rows());
+    constraints.push_back(GroupsConstraint::columns());
+    constraints.push_back(GroupsConstraint::boxes());
+    return constraints;
+}
+
+
+// Nine regions of nine cells each, given by 81 labels
+bool isJigsawLayout(const string& layout)
+{
+    if (layout.size() != static_cast<size_t>(SudokuMatrixBuilder::CELLS_COUNT))
+        return false;
+
+    for (char c : layout)
+    {
+        if (count(layout.begin(), layout.end(), c) != SudokuMatrixBuilder::PROBLEM_SIZE)
+            return false;
+    }
+    return true;
+}
+
+
+/*
+* One cage per line: its sum followed by cell indices 0..80. Returns false
+* if the file cannot be read, a cage is malformed or cages overlap
+*/
+bool readKillerCages(const string& path, vector<KillerConstraint::Cage>& cages)
+{
+    ifstream input(path);
+    if (!input)
+        return false;
+
+    vector<bool> used(SudokuMatrixBuilder::CELLS_COUNT, false);
+    string line;
+    while (getline(input, line))
+    {
+        istringstream fields(line);
+        KillerConstraint::Cage cage;
+        if (!(fields >> cage.m_sum))
+            continue;
+
+        int cell;
+        while (fields >> cell)
+        {
+            if (cell < 0 || cell >= SudokuMatrixBuilder::CELLS_COUNT || used[cell])
+                return false;
+            used[cell] = true;
+            cage.m_cells.push_back(static_cast<uint8_t>(cell));
+        }
+
+        if (!fields.eof() || cage.m_cells.empty() || cage.m_cells.size() > static_cast<size_t>(SudokuMatrixBuilder::PROBLEM_SIZE))
+            return false;
+        cages.push_back(move(cage));
+    }
+
+    return !cages.empty();
+}
+
+
+/*
+* Variant by name, empty for unknown names or malformed data. Jigsaw takes
+* its layout inline as "jigsaw:<81 labels>", killer its cages file as
+* "killer:<path>"
+*/
+SudokuConstraints variantConstraints(const string& name)
+{
+    SudokuConstraints constraints;
+
+    if (name.compare(0, 7, "jigsaw:") == 0)
+    {
+        const string layout = name.substr(7);
+        if (!isJigsawLayout(layout))
+            return constraints;
+
+        constraints.push_back(make_unique<CellsConstraint>());
+        constraints.push_back(GroupsConstraint::rows());
+        constraints.push_back(GroupsConstraint::columns());
+        constraints.push_back(GroupsConstraint::jigsaw(layout));
+        return constraints;
+    }
+
+    if (name.compare(0, 7, "killer:") == 0)
+    {
+        vector<KillerConstraint::Cage> cages;
+        if (!readKillerCages(name.substr(7), cages))
+            return constraints;
+
+        constraints = classicConstraints();
+        constraints.push_back(make_unique<KillerConstraint>(move(cages)));
+        return constraints;
+    }
+
+    if (name != "classic" && name != "diagonal" && name != "anti-knight")
+        return constraints;
+
+    constraints = classicConstraints();
+    if (name == "diagonal")
+        constraints.push_back(GroupsConstraint::diagonals());
+    else if (name == "anti-knight")
+        constraints.push_back(make_unique<AntiKnightConstraint>());
+
+    return constraints;
+}
+
+
+/*
+* Reusable 9x9 solver: the exact cover matrix is built once and every
+* puzzle only selects its givens on top of it, so per-puzzle cost is
+* the search itself
+*/
+class SudokuSolver
+{
+private:
+    static const int PROBLEM_SIZE = SudokuMatrixBuilder::PROBLEM_SIZE;
+    static const int CELLS_COUNT = SudokuMatrixBuilder::CELLS_COUNT;
+
+    AlgorithmX m_algo;
+    vector<vector<uint8_t>> m_groups;
+
+public:
+    SudokuSolver()
+        : SudokuSolver(classicConstraints())
+    {
+    }
+
+    explicit SudokuSolver(const SudokuConstraints& constraints)
+        : SudokuSolver(buildMatrix(constraints))
+    {
+        for (const auto& constraint : constraints)
+            constraint->addGroups(m_groups);
+    }
+
+    SudokuSolver(const SudokuSolver&) = delete;
+    SudokuSolver& operator=(const SudokuSolver&) = delete;
+
+    /*
+    * Solves single puzzle of 81 characters (see parsePuzzle for the format)
+    * and writes 81 characters of solution to out. On failure input is copied to out
+    */
+    Status solve(const char* puzzle, char* out)
+    {
+        Status status = selectGivens(puzzle);
+
+        if (status == Status::Solved)
+        {
+            ALGX_PHASE(Phase::Search);
+            if (!m_algo.solve())
+                status = Status::NoSolution;
+        }
+
+        if (status == Status::Solved)
+        {
+            ALGX_PHASE(Phase::Decode);
+            for (uint16_t rowId : m_algo.getSolution())
+            {
+                // Rows added by constraints carry no cell value
+                if (rowId < SudokuMatrixBuilder::CELL_ROWS_COUNT)
+                    out[rowId / PROBLEM_SIZE] = static_cast<char>('1' + rowId % PROBLEM_SIZE);
+            }
+        }
+        else
+        {
+            memcpy(out, puzzle, CELLS_COUNT);
+        }
+
+        ALGX_PHASE(Phase::Select);
+        m_algo.reset();
+
+        return status;
+    }
+
+    // Counts solutions of the puzzle up to limit, invalid puzzles have none
+    uint32_t countSolutions(const char* puzzle, uint32_t limit)
+    {
+        uint32_t count = 0;
+        if (selectGivens(puzzle) == Status::Solved)
+        {
+            ALGX_PHASE(Phase::Search);
+            count = m_algo.countSolutions(limit);
+        }
+
+        ALGX_PHASE(Phase::Select);
+        m_algo.reset();
+
+        return count;
+    }
+
+    // Search statistics of the last solved or counted puzzle
+    inline const SearchStats& lastStats() const { return m_algo.getStats(); }
+
+    // Givens repeated within one of the variant's groups, cells as parsePuzzle fills them
+    bool hasRepeats(const uint8_t* cells) const
+    {
+        for (const auto& group : m_groups)
+        {
+            // Bit v - 1 is set once value v is met, blanks map to no bit
+            uint16_t seen = 0;
+            for (uint8_t cell : group)
+            {
+                uint16_t bit = (1 << cells[cell]) >> 1;
+                if (seen & bit)
+                    return true;
+                seen |= bit;
+            }
+        }
+
+        return false;
+    }
+
+    inline void setUndoStrategy(UndoStrategy strategy) { m_algo.setUndoStrategy(strategy); }
+
+    // Matrix is built in row major order
+    inline void renumberNodes(NodeOrder order) { m_algo.renumberNodes(order); }
+
+    MemoryFootprint memoryFootprint() const
+    {
+        MemoryFootprint footprint = m_algo.memoryFootprint();
+        footprint.m_objects += sizeof(*this) - sizeof(m_algo);
+        return footprint;
+    }
+
+#ifdef ALGX_MEMS
+    inline const MemsCounters& lastCounters() const { return m_algo.getCounters(); }
+#endif
+
+#ifdef ALGX_TRACE
+    inline const SearchTrace& lastTrace() const { return m_algo.getTrace(); }
+#endif
+
+    // Makes search pick a random solution among possible ones
+    inline void setRandomEngine(mt19937* random) { m_algo.setRandomEngine(random); }
+
+    /*
+    * Solves n puzzles stored back to back (81 bytes each, no separators)
+    * into out with the same layout. status may be null
+    */
+    void solveBatch(const char* puzzles, size_t n, char* out, Status* status)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            Status s = solve(puzzles + i * CELLS_COUNT, out + i * CELLS_COUNT);
+            if (status != nullptr)
+                status[i] = s;
+        }
+    }
+
+private:
+    Status selectGivens(const char* puzzle)
+    {
+        uint8_t cells[CELLS_COUNT];
+        bool parsed;
+        {
+            ALGX_PHASE(Phase::Parse);
+            parsed = parsePuzzle(puzzle, cells) && !hasRepeats(cells);
+        }
+
+        if (!parsed)
+            return Status::InvalidInput;
+
+        // Still fails on givens sharing a column of a constraint that exposes no groups
+        ALGX_PHASE(Phase::Select);
+        for (int cell = 0; cell < CELLS_COUNT; ++cell)
+        {
+            if (cells[cell] != 0 && !m_algo.select(SudokuMatrixBuilder::cellRow(cell, cells[cell] - 1)))
+                return Status::InvalidInput;
+        }
+
+        return Status::Solved;
+    }
+
+    explicit SudokuSolver(const SudokuMatrixBuilder& builder)
+        : m_algo(builder.rowsCount(), builder.columnsCount(), builder.nodesCount(), builder.primaryColumnsCount())
+    {
+        ALGX_PHASE(Phase::Build);
+        builder.populate(m_algo);
+    }
+
+    static SudokuMatrixBuilder buildMatrix(const SudokuConstraints& constraints)
+    {
+        ALGX_PHASE(Phase::Build);
+        SudokuMatrixBuilder builder;
+        for (const auto& constraint : constraints)
+            constraint->build(builder);
+        return builder;
+    }
+};
+
+
+void solveBatch(const char* puzzles, size_t n, char* out, Status* status)
+{
+    SudokuSolver solver;
+    solver.solveBatch(puzzles, n, out, status);
+}
+
+
+/*
+* Solves LANES puzzles at once with constraint propagation only (naked and
+* hidden singles). Candidates are stored as cell-major 9-bit masks with one
+* lane per puzzle, so every propagation step is a branch free loop over lanes
+* which compiler turns into SIMD. Lanes which stall without a solution are
+* peeled off to the scalar AlgorithmX based solver
+*/
+template<int LANES>
+class LockstepSolver
+{
+private:
+    static_assert(LANES >= 4 && LANES <= 16, "Lockstep solver supports 4 to 16 lanes");
+
+    static const int PROBLEM_SIZE = 9;
+    static const int CELLS_COUNT = PROBLEM_SIZE * PROBLEM_SIZE;
+    static const int UNITS_COUNT = 3 * PROBLEM_SIZE;
+    static const int PEERS_COUNT = 20;
+    static const uint16_t ALL_CANDIDATES = (1 << PROBLEM_SIZE) - 1;
+
+    struct Topology
+    {
+        uint8_t m_units[UNITS_COUNT][PROBLEM_SIZE];
+        uint8_t m_peers[CELLS_COUNT][PEERS_COUNT];
+
+        Topology()
+        {
+            for (int k = 0; k < PROBLEM_SIZE; ++k)
+                for (int t = 0; t < PROBLEM_SIZE; ++t)
+                {
+                    m_units[k][t] = k * PROBLEM_SIZE + t;
+                    m_units[PROBLEM_SIZE + k][t] = t * PROBLEM_SIZE + k;
+                    m_units[2 * PROBLEM_SIZE + k][t] = ((k / 3) * 3 + t / 3) * PROBLEM_SIZE + (k % 3) * 3 + t % 3;
+                }
+
+            for (int cell = 0; cell < CELLS_COUNT; ++cell)
+            {
+                int count = 0;
+                for (int other = 0; other < CELLS_COUNT; ++other)
+                {
+                    int i = cell / PROBLEM_SIZE, j = cell % PROBLEM_SIZE;
+                    int oi = other / PROBLEM_SIZE, oj = other % PROBLEM_SIZE;
+                    bool isPeer = i == oi || j == oj || (i / 3 == oi / 3 && j / 3 == oj / 3);
+                    if (other != cell && isPeer)
+                        m_peers[cell][count++] = other;
+                }
+                assert(count == PEERS_COUNT);
+            }
+        }
+    };
+
+    static const Topology& topology()
+    {
+        static const Topology instance;
+        return instance;
+    }
+
+    alignas(64) uint16_t m_candidates[CELLS_COUNT][LANES];
+    SudokuSolver m_fallback;
+
+public:
+    LockstepSolver() = default;
+
+    LockstepSolver(const LockstepSolver&) = delete;
+    LockstepSolver& operator=(const LockstepSolver&) = delete;
+
+    // Lanes propagation leaves unsolved are searched by this one, e.g. to set its undo strategy
+    inline SudokuSolver& fallback() { return m_fallback; }
+
+    // Candidate masks are part of the object, the fallback solver is added on top
+    MemoryFootprint memoryFootprint() const
+    {
+        MemoryFootprint footprint = m_fallback.memoryFootprint();
+        footprint.m_objects += sizeof(*this) - sizeof(m_fallback);
+        return footprint;
+    }
+
+    /*
+    * Same contract as SudokuSolver::solveBatch, puzzles are processed
+    * in groups of LANES
+    */
+    void solveBatch(const char* puzzles, size_t n, char* out, Status* status)
+    {
+        const char* group[LANES];
+        for (size_t first = 0; first < n; first += LANES)
+        {
+            int lanes = static_cast<int>(min<size_t>(LANES, n - first));
+            for (int l = 0; l < lanes; ++l)
+                group[l] = puzzles + (first + l) * CELLS_COUNT;
+
+            solveGroup(group, lanes, out + first * CELLS_COUNT, status != nullptr ? status + first : nullptr);
+        }
+    }
+
+    /*
+    * Solves up to LANES puzzles given by pointers, so they may live anywhere,
+    * e.g. in a file mapping. Solutions are written back to back into out
+    */
+    void solveGroup(const char* const* puzzles, int lanes, char* out, Status* status)
+    {
+        assert(lanes > 0 && lanes <= LANES);
+
+        // Unused and rejected lanes stay fully open, which never stalls anything else
+        for (int cell = 0; cell < CELLS_COUNT; ++cell)
+            for (int l = 0; l < LANES; ++l)
+                m_candidates[cell][l] = ALL_CANDIDATES;
+
+        bool parsed[LANES];
+        for (int l = 0; l < lanes; ++l)
+        {
+            ALGX_PHASE(Phase::Parse);
+            uint8_t cells[CELLS_COUNT];
+            parsed[l] = parsePuzzle(puzzles[l], cells) && !m_fallback.hasRepeats(cells);
+            if (!parsed[l])
+                continue;
+
+            for (int cell = 0; cell < CELLS_COUNT; ++cell)
+            {
+                if (cells[cell] != 0)
+                    m_candidates[cell][l] = 1 << (cells[cell] - 1);
+            }
+        }
+
+        {
+            ALGX_PHASE(Phase::Search);
+            propagate();
+        }
+
+        uint16_t unsolvedLanes = 0;
+        uint16_t deadLanes = 0;
+        for (int cell = 0; cell < CELLS_COUNT; ++cell)
+            for (int l = 0; l < LANES; ++l)
+            {
+                uint16_t m = m_candidates[cell][l];
+                unsolvedLanes |= static_cast<uint16_t>((m & (m - 1)) != 0) << l;
+                deadLanes |= static_cast<uint16_t>(m == 0) << l;
+            }
+
+        for (int l = 0; l < lanes; ++l)
+        {
+            const char* puzzle = puzzles[l];
+            char* solution = out + l * CELLS_COUNT;
+            Status s;
+
+            if (!parsed[l])
+            {
+                memcpy(solution, puzzle, CELLS_COUNT);
+                s = Status::InvalidInput;
+            }
+            else if (deadLanes & (1 << l))
+            {
+                memcpy(solution, puzzle, CELLS_COUNT);
+                s = Status::NoSolution;
+            }
+            else if (unsolvedLanes & (1 << l))
+            {
+                // Peel off to search, starting from everything propagation has fixed
+                char reduced[CELLS_COUNT];
+                extractLane(l, reduced);
+                s = m_fallback.solve(reduced, solution);
+                if (s != Status::Solved)
+                    memcpy(solution, puzzle, CELLS_COUNT);
+            }
+            else
+            {
+                ALGX_PHASE(Phase::Decode);
+                extractLane(l, solution);
+                s = Status::Solved;
+            }
+
+            if (status != nullptr)
+                status[l] = s;
+        }
+    }
+
+private:
+    // Runs naked and hidden singles over all lanes until none of them changes
+    void propagate()
+    {
+        const Topology& topo = topology();
+
+        uint16_t changed;
+        do
+        {
+            alignas(64) uint16_t before[CELLS_COUNT][LANES];
+            memcpy(before, m_candidates, sizeof(before));
+
+            // Naked singles: solved cell removes its value from all peers
+            for (int cell = 0; cell < CELLS_COUNT; ++cell)
+            {
+                alignas(64) uint16_t single[LANES];
+                for (int l = 0; l < LANES; ++l)
+                {
+                    uint16_t m = m_candidates[cell][l];
+                    single[l] = (m & (m - 1)) == 0 ? m : 0;
+                }
+
+                for (int p = 0; p < PEERS_COUNT; ++p)
+                {
+                    uint16_t* peer = m_candidates[topo.m_peers[cell][p]];
+                    for (int l = 0; l < LANES; ++l)
+                        peer[l] &= ~single[l];
+                }
+            }
+
+            // Hidden singles: value possible in a single cell of the unit goes there
+            for (int u = 0; u < UNITS_COUNT; ++u)
+            {
+                alignas(64) uint16_t once[LANES] = {};
+                alignas(64) uint16_t twice[LANES] = {};
+                for (int t = 0; t < PROBLEM_SIZE; ++t)
+                {
+                    const uint16_t* cell = m_candidates[topo.m_units[u][t]];
+                    for (int l = 0; l < LANES; ++l)
+                    {
+                        twice[l] |= once[l] & cell[l];
+                        once[l] |= cell[l];
+                    }
+                }
+
+                for (int l = 0; l < LANES; ++l)
+                    once[l] &= ~twice[l];
+
+                for (int t = 0; t < PROBLEM_SIZE; ++t)
+                {
+                    uint16_t* cell = m_candidates[topo.m_units[u][t]];
+                    for (int l = 0; l < LANES; ++l)
+                    {
+                        uint16_t hidden = cell[l] & once[l];
+                        cell[l] = hidden != 0 ? hidden : cell[l];
+                    }
+                }
+            }
+
+            changed = 0;
+            for (int cell = 0; cell < CELLS_COUNT; ++cell)
+                for (int l = 0; l < LANES; ++l)
+                    changed |= before[cell][l] ^ m_candidates[cell][l];
+        } while (changed != 0);
+    }
+
+    // Writes lane as puzzle text, cells with more than one candidate left blank
+    void extractLane(int lane, char* out) const
+    {
+        for (int cell = 0; cell < CELLS_COUNT; ++cell)
+        {
+            uint16_t m = m_candidates[cell][lane];
+            char c = '0';
+            if (m != 0 && (m & (m - 1)) == 0)
+            {
+                for (int v = 0; v < PROBLEM_SIZE; ++v)
+                    if (m == (1 << v))
+                        c = static_cast<char>('1' + v);
+            }
+            out[cell] = c;
+        }
+    }
+};
+
+
+template<int LANES = 16>
+void solveBatchLockstep(const char* puzzles, size_t n, char* out, Status* status)
+{
+    LockstepSolver<LANES> solver;
+    solver.solveBatch(puzzles, n, out, status);
+}
+
+
+enum class Symmetry : uint8_t
+{
+    None,
+    Rotational,
+    Mirror
+};
+
+
+struct GeneratorOptions
+{
+    int m_minClues = 17;
+    Symmetry m_symmetry = Symmetry::None;
+};
+
+
+/*
+* Generates puzzles with a unique solution: fills a random grid via
+* randomized search, then removes clues in random order while the
+* solution count (capped at 2) stays at one
+*/
+class SudokuGenerator
+{
+private:
+    static const int CELLS_COUNT = SudokuMatrixBuilder::CELLS_COUNT;
+
+    SudokuSolver m_solver;
+    GeneratorOptions m_options;
+
+public:
+    explicit SudokuGenerator(const GeneratorOptions& options)
+        : m_options(options)
+    {
+    }
+
+    SudokuGenerator(const SudokuConstraints& constraints, const GeneratorOptions& options)
+        : m_solver(constraints)
+        , m_options(options)
+    {
+    }
+
+    SudokuGenerator(const SudokuGenerator&) = delete;
+    SudokuGenerator& operator=(const SudokuGenerator&) = delete;
+
+    // Writes 81 characters of the puzzle, '.' for blanks
+    void generate(mt19937& random, char* out)
+    {
+        const string empty(CELLS_COUNT, '.');
+
+        m_solver.setRandomEngine(&random);
+        Status status = m_solver.solve(empty.data(), out);
+        m_solver.setRandomEngine(nullptr);
+
+        assert(status == Status::Solved);
+        (void)status;
+
+        int order[CELLS_COUNT];
+        for (int cell = 0; cell < CELLS_COUNT; ++cell)
+            order[cell] = cell;
+        shuffle(order, order + CELLS_COUNT, random);
+
+        int clues = CELLS_COUNT;
+        for (int cell : order)
+        {
+            if (out[cell] == '.')
+                continue;
+
+            int group[4];
+            int groupSize = symmetricCells(cell, group);
+            if (clues - groupSize < m_options.m_minClues)
+                continue;
+
+            char removed[4];
+            for (int k = 0; k < groupSize; ++k)
+            {
+                removed[k] = out[group[k]];
+                out[group[k]] = '.';
+            }
+
+            if (m_solver.countSolutions(out, 2) == 1)
+            {
+                clues -= groupSize;
+            }
+            else
+            {
+                for (int k = 0; k < groupSize; ++k)
+                    out[group[k]] = removed[k];
+            }
+        }
+    }
+
+private:
+    // Cells which have to be removed together with the given one
+    int symmetricCells(int cell, int* group) const
+    {
+        const int size = SudokuMatrixBuilder::PROBLEM_SIZE;
+        int i = cell / size, j = cell % size;
+
+        int other;
+        switch (m_options.m_symmetry)
+        {
+        case Symmetry::Rotational:
+            other = CELLS_COUNT - 1 - cell;
+            break;
+        case Symmetry::Mirror:
+            other = i * size + size - 1 - j;
+            break;
+        default:
+            other = cell;
+            break;
+        }
+
+        group[0] = cell;
+        if (other == cell)
+            return 1;
+
+        group[1] = other;
+        return 2;
+    }
+};
+
+
+/*
+* Runs generate(random, out) of generators made by the factory, one per thread,
+* for count puzzles of 81 bytes each. Every puzzle draws from its own engine
+* seeded by (seed, index), so the output does not depend on threads count or scheduling
+*/
+template<typename GeneratorFactory>
+void generateSeeded(size_t count, unsigned threadsCount, uint64_t seed, char* out, GeneratorFactory makeGenerator)
+{
+    atomic<size_t> next(0);
+
+    auto worker = [&]()
+    {
+        auto generator = makeGenerator();
+        for (size_t index = next++; index < count; index = next++)
+        {
+            seed_seq sequence{ static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32) };
+            mt19937 random(sequence);
+            generator.generate(random, out + index * SudokuMatrixBuilder::CELLS_COUNT);
+        }
+    };
+
+    vector<thread> threads;
+    for (unsigned t = 1; t < threadsCount; ++t)
+        threads.emplace_back(worker);
+    worker();
+
+    for (auto& t : threads)
+        t.join();
+}
+
+
+void generatePuzzles(size_t count, const GeneratorOptions& options, unsigned threadsCount, uint64_t seed, char* out)
+{
+    generateSeeded(count, threadsCount, seed, out, [&options]() { return SudokuGenerator(options); });
+}
+
+
+enum class Stratum : uint8_t
+{
+    SinglesOnly,
+    Minimal,
+    SearchHeavy,
+    Unsolvable,
+    MultiSolution,
+    Count
+};
+
+
+const char* stratumName(Stratum stratum)
+{
+    switch (stratum)
+    {
+    case Stratum::SinglesOnly:
+        return "singles";
+    case Stratum::Minimal:
+        return "minimal";
+    case Stratum::SearchHeavy:
+        return "search-heavy";
+    case Stratum::Unsolvable:
+        return "unsolvable";
+    case Stratum::MultiSolution:
+        return "multi-solution";
+    default:
+        return "unknown";
+    }
+}
+
+
+/*
+* Benchmark corpus puzzles of one stratum, all derived from minimal puzzles of
+* SudokuGenerator. Random removal practically never gets down to 17 clues,
+* so minimal means no clue can be removed, typically 21-26 clues
+*/
+class CorpusGenerator
+{
+private:
+    static const int CELLS_COUNT = SudokuMatrixBuilder::CELLS_COUNT;
+    static const int PROBLEM_SIZE = SudokuMatrixBuilder::PROBLEM_SIZE;
+
+    SudokuGenerator m_generator;
+    SudokuSolver m_solver;
+    Stratum m_stratum;
+
+public:
+    explicit CorpusGenerator(Stratum stratum)
+        : m_generator(GeneratorOptions())
+        , m_stratum(stratum)
+    {
+    }
+
+    CorpusGenerator(const CorpusGenerator&) = delete;
+    CorpusGenerator& operator=(const CorpusGenerator&) = delete;
+
+    void generate(mt19937& random, char* out)
+    {
+        switch (m_stratum)
+        {
+        case Stratum::SinglesOnly:
+            // About a third of minimal puzzles never need a guess
+            do
+            {
+                m_generator.generate(random, out);
+            } while (grade(out) != Difficulty::Easy);
+            break;
+        case Stratum::SearchHeavy:
+            do
+            {
+                m_generator.generate(random, out);
+            } while (grade(out) != Difficulty::Expert);
+            break;
+        case Stratum::Unsolvable:
+            m_generator.generate(random, out);
+            addWrongGiven(random, out);
+            break;
+        case Stratum::MultiSolution:
+            m_generator.generate(random, out);
+            removeGiven(random, out);
+            break;
+        default:
+            m_generator.generate(random, out);
+            break;
+        }
+    }
+
+private:
+    Difficulty grade(const char* puzzle)
+    {
+        char solution[CELLS_COUNT];
+        m_solver.solve(puzzle, solution);
+        return rateDifficulty(m_solver.lastStats()).m_grade;
+    }
+
+    /*
+    * Puts a value differing from the unique solution into a blank cell. It does not
+    * clash with givens, so only the search finds out there is no solution
+    */
+    void addWrongGiven(mt19937& random, char* puzzle)
+    {
+        char solution[CELLS_COUNT];
+        m_solver.solve(puzzle, solution);
+
+        int order[CELLS_COUNT];
+        for (int cell = 0; cell < CELLS_COUNT; ++cell)
+            order[cell] = cell;
+        shuffle(order, order + CELLS_COUNT, random);
+
+        for (int cell : order)
+        {
+            if (puzzle[cell] != '.')
+                continue;
+
+            const int i = cell / PROBLEM_SIZE, j = cell % PROBLEM_SIZE;
+            const int boxI = i / 3 * 3, boxJ = j / 3 * 3;
+
+            bool used[PROBLEM_SIZE + 1] = {};
+            used[solution[cell] - '0'] = true;
+            for (int k = 0; k < PROBLEM_SIZE; ++k)
+            {
+                for (char c : { puzzle[i * PROBLEM_SIZE + k], puzzle[k * PROBLEM_SIZE + j], puzzle[(boxI + k / 3) * PROBLEM_SIZE + boxJ + k % 3] })
+                {
+                    if (c != '.')
+                        used[c - '0'] = true;
+                }
+            }
+
+            char values[PROBLEM_SIZE];
+            int valuesCount = 0;
+            for (int v = 1; v <= PROBLEM_SIZE; ++v)
+            {
+                if (!used[v])
+                    values[valuesCount++] = static_cast<char>('0' + v);
+            }
+
+            if (valuesCount > 0)
+            {
+                puzzle[cell] = values[random() % valuesCount];
+                return;
+            }
+        }
+    }
+
+    // Puzzle is minimal, so dropping any given leaves several solutions
+    void removeGiven(mt19937& random, char* puzzle)
+    {
+        int givens[CELLS_COUNT];
+        int givensCount = 0;
+        for (int cell = 0; cell < CELLS_COUNT; ++cell)
+        {
+            if (puzzle[cell] != '.')
+                givens[givensCount++] = cell;
+        }
+
+        puzzle[givens[random() % givensCount]] = '.';
+    }
+};
+
+
+// Same (seed, count) gives the same corpus; strata draw from different streams
+void generateCorpus(Stratum stratum, size_t count, unsigned threadsCount, uint64_t seed, char* out)
+{
+    const uint64_t stratumSeed = seed ^ (static_cast<uint64_t>(stratum) + 1) * 0x9E3779B97F4A7C15ull;
+    generateSeeded(count, threadsCount, stratumSeed, out, [stratum]() { return CorpusGenerator(stratum); });
+}
+
+
+class SudokuProblem
+{
+private:
+    static const int PROBLEM_SIZE = 9;
+
+    vector<vector<int>> problem;
+
+public:
+    // False once the input was rejected by the parser
+    bool validInput = true;
+    bool hasSolution = false;
+    vector<vector<int>> solvedProblem;
+    SearchStats searchStats;
+
+    SudokuProblem(const string& data)
+        : problem(PROBLEM_SIZE, vector<int>(PROBLEM_SIZE, 0)), solvedProblem(PROBLEM_SIZE, vector<int>(PROBLEM_SIZE, 0))
+    {
+        uint8_t cells[PROBLEM_SIZE * PROBLEM_SIZE];
+        validInput = data.size() == PROBLEM_SIZE * PROBLEM_SIZE && parsePuzzle(data.data(), cells);
+        if (!validInput)
+            return;
+
+        for (int i = 0; i < PROBLEM_SIZE; ++i)
+        {
+            for (int j = 0; j < PROBLEM_SIZE; ++j)
+                problem[i][j] = cells[i * PROBLEM_SIZE + j];
+        }
+    }
+
+    void solve()
+    {
+        solve(classicConstraints());
+    }
+
+    void solve(const SudokuConstraints& constraints)
+    {
+        if (!validInput)
+            return;
+
+        char puzzle[PROBLEM_SIZE * PROBLEM_SIZE];
+        for (int i = 0; i < PROBLEM_SIZE; ++i)
+            for (int j = 0; j < PROBLEM_SIZE; ++j)
+                puzzle[i * PROBLEM_SIZE + j] = static_cast<char>('0' + problem[i][j]);
+
+        SudokuSolver solver(constraints);
+        char solution[PROBLEM_SIZE * PROBLEM_SIZE];
+        hasSolution = solver.solve(puzzle, solution) == Status::Solved;
+        searchStats = solver.lastStats();
+
+        // cout << "Solution was successfull: " << success << endl;
+
+        if (hasSolution)
+        {
+            for (int i = 0; i < PROBLEM_SIZE; ++i)
+                for (int j = 0; j < PROBLEM_SIZE; ++j)
+                    solvedProblem[i][j] = solution[i * PROBLEM_SIZE + j] - '0';
+        }
+    }
+
+    inline DifficultyRating rating() const { return rateDifficulty(searchStats); }
+};
+
+/*
+* Read-only memory mapping of a puzzles file. Lines are handed out as views
+* into the mapping, so puzzles reach the solver without being copied
+*/
+class MappedPuzzleFile
+{
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_offset = 0;
+    bool m_open = false;
+
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+
+public:
+    explicit MappedPuzzleFile(const string& path)
+    {
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size))
+            return;
+
+        m_size = static_cast<size_t>(size.QuadPart);
+        m_open = true;
+        if (m_size == 0)
+            return;
+
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping != nullptr)
+            m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0)
+        {
+            m_size = static_cast<size_t>(info.st_size);
+            m_open = true;
+
+            if (m_size > 0)
+            {
+                void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED)
+                {
+                    madvise(data, m_size, MADV_SEQUENTIAL);
+                    m_data = static_cast<const char*>(data);
+                }
+            }
+        }
+
+        // Mapping stays valid after the descriptor is closed
+        close(fd);
+#endif
+
+        if (m_size > 0 && m_data == nullptr)
+            m_open = false;
+    }
+
+    ~MappedPuzzleFile()
+    {
+#ifdef _WIN32
+        if (m_data != nullptr)
+            UnmapViewOfFile(m_data);
+        if (m_mapping != nullptr)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+#else
+        if (m_data != nullptr)
+            munmap(const_cast<char*>(m_data), m_size);
+#endif
+    }
+
+    MappedPuzzleFile(const MappedPuzzleFile&) = delete;
+    MappedPuzzleFile& operator=(const MappedPuzzleFile&) = delete;
+
+    inline bool isOpen() const { return m_open; }
+
+    // Next line without its terminator, false at the end of file
+    bool nextLine(string_view& line)
+    {
+        if (m_offset >= m_size)
+            return false;
+
+        const char* begin = m_data + m_offset;
+        const char* end = static_cast<const char*>(memchr(begin, '\n', m_size - m_offset));
+        if (end == nullptr)
+            end = m_data + m_size;
+
+        m_offset = end - m_data + 1;
+
+        while (end != begin && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+            --end;
+
+        line = string_view(begin, end - begin);
+        return true;
+    }
+
+    // Next line of exactly 81 characters, nullptr at the end of file
+    const char* nextPuzzle()
+    {
+        string_view line;
+        while (nextLine(line))
+        {
+            if (line.size() == 81)
+                return line.data();
+        }
+
+        return nullptr;
+    }
+
+    inline void rewind() { m_offset = 0; }
+};
+
+
+/*
+* Splits a stream into lines through a large buffer, so input of any size
+* is read with few system calls and never held in memory as a whole. Views
+* returned by nextLine() stay valid until the next call
+*/
+class LineReader
+{
+private:
+    FILE* m_file;
+    vector<char> m_buffer;
+    size_t m_begin = 0;
+    size_t m_end = 0;
+    bool m_eof = false;
+
+    // Last line was cut, its tail is dropped on the next call
+    bool m_skipping = false;
+
+public:
+    explicit LineReader(FILE* file, size_t bufferSize = 1 << 20)
+        : m_file(file)
+        , m_buffer(bufferSize)
+    {
+    }
+
+    LineReader(const LineReader&) = delete;
+    LineReader& operator=(const LineReader&) = delete;
+
+    // Next line without its terminator, false at the end of stream. Overlong lines are cut
+    bool nextLine(string_view& line)
+    {
+        if (m_skipping && !skipRestOfLine())
+            return false;
+
+        for (;;)
+        {
+            const char* begin = m_buffer.data() + m_begin;
+            const char* newline = static_cast<const char*>(memchr(begin, '\n', m_end - m_begin));
+
+            if (newline != nullptr || (m_eof && m_begin < m_end) || (m_begin == 0 && m_end == m_buffer.size()))
+            {
+                const char* end = newline != nullptr ? newline : m_buffer.data() + m_end;
+                m_begin = newline != nullptr ? end - m_buffer.data() + 1 : m_end;
+                m_skipping = newline == nullptr && !m_eof;
+
+                while (end != begin && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+                    --end;
+
+                line = string_view(begin, end - begin);
+                return true;
+            }
+
+            if (m_eof)
+                return false;
+
+            refill();
+        }
+    }
+
+private:
+    void refill()
+    {
+        memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+
+        size_t read = fread(m_buffer.data() + m_end, 1, m_buffer.size() - m_end, m_file);
+        m_end += read;
+        if (read == 0)
+            m_eof = true;
+    }
+
+    // Drops the tail of a line which did not fit into the buffer, false at the end of stream
+    bool skipRestOfLine()
+    {
+        for (;;)
+        {
+            const char* newline = static_cast<const char*>(memchr(m_buffer.data() + m_begin, '\n', m_end - m_begin));
+            if (newline != nullptr)
+            {
+                m_begin = newline - m_buffer.data() + 1;
+                m_skipping = false;
+                return true;
+            }
+
+            m_begin = m_end;
+            if (m_eof)
+                return false;
+            refill();
+        }
+    }
+};
+
+
+// Collects output in a large buffer and hands it to the stream in big writes
+class BufferedWriter
+{
+private:
+    FILE* m_file;
+    vector<char> m_buffer;
+    size_t m_size = 0;
+
+public:
+    explicit BufferedWriter(FILE* file, size_t bufferSize = 1 << 20)
+        : m_file(file)
+        , m_buffer(bufferSize)
+    {
+    }
+
+    ~BufferedWriter()
+    {
+        flush();
+    }
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    void write(const char* data, size_t size)
+    {
+        if (m_size + size > m_buffer.size())
+        {
+            flush();
+            if (size > m_buffer.size())
+            {
+                fwrite(data, 1, size, m_file);
+                return;
+            }
+        }
+
+        memcpy(m_buffer.data() + m_size, data, size);
+        m_size += size;
+    }
+
+    inline void put(char c)
+    {
+        if (m_size == m_buffer.size())
+            flush();
+        m_buffer[m_size++] = c;
+    }
+
+    void flush()
+    {
+        if (m_size > 0)
+            fwrite(m_buffer.data(), 1, m_size, m_file);
+        m_size = 0;
+        fflush(m_file);
+    }
+};
+
+
+/*
+* Bounded lock-free multi-producer multi-consumer queue (Vyukov's ring).
+* Every cell carries a sequence number telling whether it is ready to be
+* written or read on the current lap, so push and pop are a single CAS
+*/
+template<typename T>
+class MpmcQueue
+{
+private:
+    struct Cell
+    {
+        atomic<size_t> m_sequence;
+        T m_value;
+    };
+
+    unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+
+    alignas(64) atomic<size_t> m_pushPos;
+    alignas(64) atomic<size_t> m_popPos;
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit MpmcQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+
+        m_cells.reset(new Cell[size]);
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; ++i)
+            m_cells[i].m_sequence.store(i, memory_order_relaxed);
+
+        m_pushPos.store(0, memory_order_relaxed);
+        m_popPos.store(0, memory_order_relaxed);
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool tryPush(const T& value)
+    {
+        size_t pos = m_pushPos.load(memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t sequence = cell.m_sequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+            if (diff == 0)
+            {
+                if (m_pushPos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                {
+                    cell.m_value = value;
+                    cell.m_sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // Full
+                return false;
+            }
+            else
+            {
+                pos = m_pushPos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value)
+    {
+        size_t pos = m_popPos.load(memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t sequence = cell.m_sequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+
+            if (diff == 0)
+            {
+                if (m_popPos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                {
+                    value = cell.m_value;
+                    cell.m_sequence.store(pos + m_mask + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // Empty
+                return false;
+            }
+            else
+            {
+                pos = m_popPos.load(memory_order_relaxed);
+            }
+        }
+    }
+};
+
+
+// Spins first, then yields and finally sleeps, so idle waiters do not burn a core for long
+class Backoff
+{
+private:
+    uint32_t m_attempts = 0;
+
+public:
+    void wait()
+    {
+        ++m_attempts;
+        if (m_attempts < 64)
+            return;
+        if (m_attempts < 1024)
+            this_thread::yield();
+        else
+            this_thread::sleep_for(chrono::microseconds(50));
+    }
+
+    inline void reset() { m_attempts = 0; }
+};
+
+
+using BatchSolveFn = function<void(const char* puzzles, size_t n, char* out, Status* status)>;
+
+// Called once on every worker thread, the solver it returns is owned by that thread
+using BatchSolverFactory = function<BatchSolveFn()>;
+
+
+/*
+* Solves a stream of puzzles on worker threads. Input is cut into chunks
+* which workers claim from a lock-free queue, each worker with its own
+* solver. Every chunk slot owns its result buffers, so workers never share
+* a cache line while solving. Finished chunks wait in a reorder window until
+* all earlier ones are handed out, so output order matches input
+*/
+class BatchDriver
+{
+public:
+    // Fills up to capacity puzzles (81 bytes each), returns 0 at the end of input
+    using FillFn = function<size_t(char* puzzles, size_t capacity)>;
+
+    // Receives solved chunks strictly in input order
+    using EmitFn = function<void(const char* puzzles, const char* solutions, const Status* statuses, size_t count)>;
+
+    static const size_t DEFAULT_CHUNK_SIZE = 256;
+
+private:
+    struct alignas(64) Chunk
+    {
+        atomic<bool> m_done{ false };
+        size_t m_count = 0;
+        vector<char> m_puzzles;
+        vector<char> m_solutions;
+        vector<Status> m_statuses;
+    };
+
+    unsigned m_threadsCount;
+    size_t m_chunkSize;
+    BatchSolverFactory m_factory;
+
+    vector<Chunk> m_window;
+    MpmcQueue<size_t> m_queue;
+    atomic<bool> m_finished{ false };
+
+public:
+    BatchDriver(unsigned threadsCount, size_t chunkSize, BatchSolverFactory factory)
+        : m_threadsCount(max(1u, threadsCount))
+        , m_chunkSize(max<size_t>(1, chunkSize))
+        , m_factory(move(factory))
+        , m_window(4 * m_threadsCount)
+        , m_queue(m_window.size())
+    {
+        for (Chunk& chunk : m_window)
+        {
+            chunk.m_puzzles.resize(m_chunkSize * 81);
+            chunk.m_solutions.resize(m_chunkSize * 81);
+            chunk.m_statuses.resize(m_chunkSize);
+        }
+    }
+
+    BatchDriver(const BatchDriver&) = delete;
+    BatchDriver& operator=(const BatchDriver&) = delete;
+
+    // Reorder window chunks, allocated once for the driver lifetime
+    size_t bufferBytes() const
+    {
+        size_t bytes = m_window.capacity() * sizeof(Chunk);
+        for (const Chunk& chunk : m_window)
+            bytes += chunk.m_puzzles.capacity() + chunk.m_solutions.capacity() + chunk.m_statuses.capacity() * sizeof(Status);
+        return bytes;
+    }
+
+    // Returns number of puzzles processed
+    size_t run(const FillFn& fill, const EmitFn& emit)
+    {
+        m_finished.store(false, memory_order_relaxed);
+
+        vector<thread> workers;
+        for (unsigned t = 0; t < m_threadsCount; ++t)
+            workers.emplace_back(&BatchDriver::workerLoop, this);
+
+        // Chunk with sequence number s lives in window slot s % window size
+        size_t nextToFill = 0;
+        size_t nextToEmit = 0;
+        size_t total = 0;
+        bool inputLeft = true;
+
+        while (inputLeft || nextToEmit < nextToFill)
+        {
+            while (inputLeft && nextToFill - nextToEmit < m_window.size())
+            {
+                const size_t slot = nextToFill % m_window.size();
+                Chunk& chunk = m_window[slot];
+
+                chunk.m_count = fill(chunk.m_puzzles.data(), m_chunkSize);
+                if (chunk.m_count == 0)
+                {
+                    inputLeft = false;
+                    break;
+                }
+
+                // Queue holds the whole window, so there is always room
+                chunk.m_done.store(false, memory_order_relaxed);
+                bool pushed = m_queue.tryPush(slot);
+                assert(pushed);
+                (void)pushed;
+
+                ++nextToFill;
+            }
+
+            if (nextToEmit == nextToFill)
+                continue;
+
+            Chunk& oldest = m_window[nextToEmit % m_window.size()];
+            Backoff backoff;
+            while (!oldest.m_done.load(memory_order_acquire))
+                backoff.wait();
+
+            emit(oldest.m_puzzles.data(), oldest.m_solutions.data(), oldest.m_statuses.data(), oldest.m_count);
+            total += oldest.m_count;
+            ++nextToEmit;
+        }
+
+        m_finished.store(true, memory_order_release);
+        for (auto& worker : workers)
+            worker.join();
+
+        return total;
+    }
+
+private:
+    void workerLoop()
+    {
+        BatchSolveFn solve = m_factory();
+        Backoff backoff;
+
+        for (;;)
+        {
+            size_t slot;
+            if (!m_queue.tryPop(slot))
+            {
+                if (m_finished.load(memory_order_acquire))
+                    return;
+
+                backoff.wait();
+                continue;
+            }
+
+            backoff.reset();
+
+            Chunk& chunk = m_window[slot];
+            solve(chunk.m_puzzles.data(), chunk.m_count, chunk.m_solutions.data(), chunk.m_statuses.data());
+            chunk.m_done.store(true, memory_order_release);
+        }
+    }
+};
+
+
+/*
+* HDR-style histogram: values below 64 are exact, above that every power of
+* two is split into 32 linear buckets, so any recorded value is known within
+* about 3% at fixed memory cost. Also keeps ids of the slowest samples
+*/
+class LatencyHistogram
+{
+private:
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int EXACT_LIMIT = 2 * SUB_BUCKETS;
+    static const int BUCKETS_COUNT = EXACT_LIMIT + (64 - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+    vector<uint64_t> m_counts;
+    uint64_t m_total = 0;
+    uint64_t m_max = 0;
+
+    size_t m_slowestLimit;
+    // Min-heap of (value, id), the fastest of the kept samples on top
+    vector<pair<uint64_t, size_t>> m_slowest;
+
+public:
+    explicit LatencyHistogram(size_t slowestLimit = 5)
+        : m_counts(BUCKETS_COUNT, 0)
+        , m_slowestLimit(slowestLimit)
+    {
+    }
+
+    void record(uint64_t value, size_t id)
+    {
+        ++m_counts[bucketOf(value)];
+        ++m_total;
+        m_max = max(m_max, value);
+
+        if (m_slowest.size() < m_slowestLimit)
+        {
+            m_slowest.emplace_back(value, id);
+            push_heap(m_slowest.begin(), m_slowest.end(), greater<pair<uint64_t, size_t>>());
+        }
+        else if (m_slowestLimit > 0 && value > m_slowest.front().first)
+        {
+            pop_heap(m_slowest.begin(), m_slowest.end(), greater<pair<uint64_t, size_t>>());
+            m_slowest.back() = make_pair(value, id);
+            push_heap(m_slowest.begin(), m_slowest.end(), greater<pair<uint64_t, size_t>>());
+        }
+    }
+
+    inline uint64_t count() const { return m_total; }
+    inline uint64_t maxValue() const { return m_max; }
+
+    // Upper bound of the bucket holding the given percentile
+    uint64_t percentile(double p) const
+    {
+        if (m_total == 0)
+            return 0;
+
+        uint64_t target = max<uint64_t>(1, static_cast<uint64_t>(ceil(p / 100.0 * m_total)));
+        uint64_t seen = 0;
+        for (int bucket = 0; bucket < BUCKETS_COUNT; ++bucket)
+        {
+            seen += m_counts[bucket];
+            if (seen >= target)
+                return min(bucketUpperBound(bucket), m_max);
+        }
+
+        return m_max;
+    }
+
+    // Slowest samples as (value, id), slowest first
+    vector<pair<uint64_t, size_t>> slowest() const
+    {
+        vector<pair<uint64_t, size_t>> result(m_slowest);
+        sort(result.rbegin(), result.rend());
+        return result;
+    }
+
+private:
+    static inline int highestBit(uint64_t value)
+    {
+        int bit = 0;
+        while (value >>= 1)
+            ++bit;
+        return bit;
+    }
+
+    static inline int bucketOf(uint64_t value)
+    {
+        if (value < EXACT_LIMIT)
+            return static_cast<int>(value);
+
+        int shift = highestBit(value) - SUB_BUCKET_BITS;
+        return EXACT_LIMIT + (shift - 1) * SUB_BUCKETS + static_cast<int>((value >> shift) - SUB_BUCKETS);
+    }
+
+    static inline uint64_t bucketUpperBound(int bucket)
+    {
+        if (bucket < EXACT_LIMIT)
+            return bucket;
+
+        int shift = (bucket - EXACT_LIMIT) / SUB_BUCKETS + 1;
+        uint64_t base = SUB_BUCKETS + (bucket - EXACT_LIMIT) % SUB_BUCKETS;
+        return ((base + 1) << shift) - 1;
+    }
+};
+
+
+/*
+* Hardware performance counters of the calling thread via perf_event_open,
+* Linux only. Events the CPU or the kernel settings do not allow stay closed;
+* counts are scaled when the kernel had to multiplex them
+*/
+class HardwareCounters
+{
+public:
+    enum Event
+    {
+        Cycles,
+        Instructions,
+        L1Misses,
+        LlcMisses,
+        BranchMisses,
+        EventsCount
+    };
+
+private:
+    int m_fds[EventsCount];
+
+public:
+    HardwareCounters()
+    {
+        for (int event = 0; event < EventsCount; ++event)
+            m_fds[event] = open(static_cast<Event>(event));
+    }
+
+    ~HardwareCounters()
+    {
+#ifdef __linux__
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+#endif
+    }
+
+    HardwareCounters(const HardwareCounters&) = delete;
+    HardwareCounters& operator=(const HardwareCounters&) = delete;
+
+    // IPC needs at least cycles and instructions
+    inline bool isOpen() const { return m_fds[Cycles] >= 0 && m_fds[Instructions] >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void stop()
+    {
+#ifdef __linux__
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+#endif
+    }
+
+    // Returns false if the event is not available
+    bool read(Event event, double& value) const
+    {
+#ifdef __linux__
+        // Value, time enabled, time running
+        uint64_t data[3];
+        if (m_fds[event] < 0 || ::read(m_fds[event], data, sizeof(data)) != sizeof(data))
+            return false;
+
+        value = data[2] > 0 ? static_cast<double>(data[0]) * data[1] / data[2] : 0;
+        return true;
+#else
+        (void)event;
+        (void)value;
+        return false;
+#endif
+    }
+
+    static const char* eventName(Event event)
+    {
+        static const char* const NAMES[] = { "cycles", "instructions", "L1d misses", "LLC misses", "branch misses" };
+        return NAMES[event];
+    }
+
+private:
+    static int open(Event event)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        switch (event)
+        {
+        case Cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case Instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case L1Misses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case LlcMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        }
+
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        (void)event;
+        return -1;
+#endif
+    }
+};
+
+
+void printHardwareCounters(ostream& stream, const HardwareCounters& counters, size_t puzzles, uint64_t searchNodes)
+{
+    double cycles = 0, instructions = 0;
+    counters.read(HardwareCounters::Cycles, cycles);
+    counters.read(HardwareCounters::Instructions, instructions);
+    stream << "IPC " << (cycles > 0 ? instructions / cycles : 0) << endl;
+
+    for (int event = 0; event < HardwareCounters::EventsCount; ++event)
+    {
+        double value = 0;
+        if (!counters.read(static_cast<HardwareCounters::Event>(event), value))
+            continue;
+
+        stream << HardwareCounters::eventName(static_cast<HardwareCounters::Event>(event)) << ": " << value / max<size_t>(1, puzzles) << "/puzzle";
+        if (searchNodes > 0)
+            stream << ", " << value / searchNodes << "/search node";
+        stream << endl;
+    }
+}
+
+
+struct Options
+{
+    // Benchmarking based on easy kaggle set
+    // string m_inputPath = "test_sudoku_full.txt";
+    string m_inputPath = "test_sudoku.txt";
+    bool m_inputGiven = false;
+    bool m_lockstep = false;
+    bool m_stream = false;
+    bool m_queueBenchmark = false;
+    bool m_tableBenchmark = false;
+    bool m_strata = false;
+    bool m_json = false;
+    bool m_perf = false;
+    bool m_undoBenchmark = false;
+    UndoStrategy m_undo = UndoStrategy::Auto;
+    NodeOrder m_layout = NodeOrder::Build;
+    bool m_layoutBenchmark = false;
+    bool m_rate = false;
+    string m_variant = "classic";
+
+    size_t m_generateCount = 0;
+    size_t m_corpusCount = 0;
+    GeneratorOptions m_generator;
+    // 0 until given: benchmarks run on one thread, per-puzzle reports need it
+    unsigned m_threads = 0;
+    size_t m_chunkSize = BatchDriver::DEFAULT_CHUNK_SIZE;
+    uint64_t m_seed = 0;
+
+    // Search trace recording and conversion, format is folded or dot
+    string m_tracePath;
+    string m_traceDumpPath;
+    string m_traceFormat = "folded";
+
+    // Strata benchmark: runs per stratum reduced to medians, baseline and allowed slowdown
+    int m_runs = 1;
+    string m_baselinePath;
+    double m_threshold = 0.05;
+};
+
+
+bool checkSolverOptions(const Options& options)
+{
+    if (variantConstraints(options.m_variant).empty())
+    {
+        cerr << "Unknown or malformed variant " << options.m_variant << endl;
+        return false;
+    }
+
+    if (options.m_lockstep && options.m_variant != "classic")
+    {
+        cerr << "Lockstep mode supports classic sudoku only" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+// Search settings from the command line, the same for every solver of a run
+void configureSolver(SudokuSolver& solver, const Options& options)
+{
+    solver.setUndoStrategy(options.m_undo);
+    solver.renumberNodes(options.m_layout);
+}
+
+
+// Keeps solvers of the workers reachable to query their memory after the run
+struct SolverFootprints
+{
+    mutex m_mutex;
+    vector<function<MemoryFootprint()>> m_probes;
+
+    template<typename Solver>
+    void add(const shared_ptr<Solver>& solver)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_probes.push_back([solver]() { return solver->memoryFootprint(); });
+    }
+};
+
+
+// Every batch driver worker gets its own solver for the selected mode and variant
+BatchSolverFactory solverFactory(const Options& options, SolverFootprints* footprints = nullptr)
+{
+    return [&options, footprints]() -> BatchSolveFn
+    {
+        if (options.m_lockstep)
+        {
+            auto solver = make_shared<LockstepSolver<16>>();
+            configureSolver(solver->fallback(), options);
+            if (footprints != nullptr)
+                footprints->add(solver);
+            return [solver](const char* puzzles, size_t n, char* out, Status* status) { solver->solveBatch(puzzles, n, out, status); };
+        }
+
+        auto solver = make_shared<SudokuSolver>(variantConstraints(options.m_variant));
+        configureSolver(*solver, options);
+        if (footprints != nullptr)
+            footprints->add(solver);
+        return [solver](const char* puzzles, size_t n, char* out, Status* status) { solver->solveBatch(puzzles, n, out, status); };
+    };
+}
+
+
+int runBenchmark(const Options& options)
+{
+    if (!checkSolverOptions(options))
+        return 1;
+
+    auto start = std::chrono::steady_clock::now();
+
+    MappedPuzzleFile input(options.m_inputPath);
+    if (!input.isOpen())
+    {
+        cerr << "Cannot open " << options.m_inputPath << endl;
+        return 1;
+    }
+
+    const int LANES = 16;
+    char solutions[LANES * 81];
+    Status statuses[LANES];
+
+    // Per-puzzle latency and hardware counters are tracked on the single-threaded paths only
+    LatencyClock clock;
+    LatencyHistogram latencies;
+
+    unique_ptr<HardwareCounters> counters;
+    if (options.m_perf && options.m_threads > 1)
+    {
+        cerr << "Hardware counters need a single thread, --perf is ignored" << endl;
+    }
+    else if (options.m_perf)
+    {
+        counters.reset(new HardwareCounters());
+        if (!counters->isOpen())
+        {
+            cerr << "Hardware counters are not available" << endl;
+            counters.reset();
+        }
+    }
+    uint64_t searchNodes = 0;
+
+    // Biggest solver footprint among workers, batch driver buffers are shared by all of them
+    MemoryFootprint peakFootprint;
+    size_t driverBytes = 0;
+
+    size_t problemsCount = 0;
+    if (options.m_threads > 1)
+    {
+        SolverFootprints footprints;
+        BatchDriver driver(options.m_threads, options.m_chunkSize, solverFactory(options, &footprints));
+
+        auto fill = [&](char* puzzles, size_t capacity)
+        {
+            size_t count = 0;
+            for (const char* puzzle = nullptr; count < capacity && (puzzle = input.nextPuzzle()) != nullptr; ++count)
+                memcpy(puzzles + count * 81, puzzle, 81);
+            return count;
+        };
+
+        problemsCount = driver.run(fill, [](const char*, const char*, const Status*, size_t) {});
+
+        for (const auto& probe : footprints.m_probes)
+        {
+            MemoryFootprint footprint = probe();
+            if (footprint.total() > peakFootprint.total())
+                peakFootprint = footprint;
+        }
+        driverBytes = driver.bufferBytes();
+    }
+    else if (options.m_lockstep)
+    {
+        LockstepSolver<LANES> solver;
+        configureSolver(solver.fallback(), options);
+        const char* group[LANES];
+        int lanes = 0;
+
+        // Every puzzle of a group waits for the whole group
+        auto solveGroup = [&]()
+        {
+            uint64_t groupStart = LatencyClock::now();
+            solver.solveGroup(group, lanes, solutions, statuses);
+            uint64_t elapsed = LatencyClock::now() - groupStart;
+
+            for (int l = 0; l < lanes; ++l)
+                latencies.record(elapsed, problemsCount + l);
+
+            problemsCount += lanes;
+            lanes = 0;
+        };
+
+#ifdef ALGX_ALLOC_STATS
+        const AllocationCounts allocationsBefore = t_allocations;
+#endif
+        if (counters)
+            counters->start();
+
+        for (const char* puzzle = input.nextPuzzle(); puzzle != nullptr; puzzle = input.nextPuzzle())
+        {
+            group[lanes++] = puzzle;
+            if (lanes == LANES)
+                solveGroup();
+        }
+
+        if (lanes > 0)
+            solveGroup();
+
+        if (counters)
+            counters->stop();
+
+        peakFootprint = solver.memoryFootprint();
+
+#ifdef ALGX_ALLOC_STATS
+        if (problemsCount > 0)
+        {
+            cout << "Allocations/puzzle " << static_cast<double>(t_allocations.m_allocations - allocationsBefore.m_allocations) / problemsCount <<
+                ", bytes/puzzle " << static_cast<double>(t_allocations.m_bytes - allocationsBefore.m_bytes) / problemsCount << endl;
+        }
+#endif
+    }
+    else
+    {
+#ifdef ALGX_ALLOC_STATS
+        const AllocationCounts setupBefore = t_allocations;
+#endif
+        SudokuSolver solver(variantConstraints(options.m_variant));
+        configureSolver(solver, options);
+#ifdef ALGX_ALLOC_STATS
+        cout << "Solver setup: " << t_allocations.m_allocations - setupBefore.m_allocations << " allocations, " <<
+            t_allocations.m_bytes - setupBefore.m_bytes << " bytes" << endl;
+
+        uint64_t allocations = 0, allocatedBytes = 0, maxAllocations = 0;
+#endif
+#ifdef ALGX_MEMS
+        uint64_t mems = 0, updates = 0;
+#endif
+        if (counters)
+            counters->start();
+
+        for (const char* puzzle = input.nextPuzzle(); puzzle != nullptr; puzzle = input.nextPuzzle())
+        {
+#ifdef ALGX_ALLOC_STATS
+            const AllocationCounts puzzleBefore = t_allocations;
+#endif
+            uint64_t puzzleStart = LatencyClock::now();
+            solver.solve(puzzle, solutions);
+            latencies.record(LatencyClock::now() - puzzleStart, problemsCount);
+            searchNodes += solver.lastStats().m_nodesVisited;
+
+#ifdef ALGX_ALLOC_STATS
+            allocations += t_allocations.m_allocations - puzzleBefore.m_allocations;
+            allocatedBytes += t_allocations.m_bytes - puzzleBefore.m_bytes;
+            maxAllocations = max(maxAllocations, t_allocations.m_allocations - puzzleBefore.m_allocations);
+#endif
+
+#ifdef ALGX_MEMS
+            mems += solver.lastCounters().m_mems;
+            updates += solver.lastCounters().m_linkUpdates;
+#endif
+            ++problemsCount;
+        }
+
+        if (counters)
+            counters->stop();
+
+        peakFootprint = solver.memoryFootprint();
+
+#ifdef ALGX_ALLOC_STATS
+        if (problemsCount > 0)
+        {
+            cout << "Allocations/puzzle " << static_cast<double>(allocations) / problemsCount << " (max " << maxAllocations << "), bytes/puzzle " <<
+                static_cast<double>(allocatedBytes) / problemsCount << endl;
+        }
+#endif
+#ifdef ALGX_MEMS
+        if (problemsCount > 0)
+            cout << "Mems/puzzle " << static_cast<double>(mems) / problemsCount << ", link updates/puzzle " << static_cast<double>(updates) / problemsCount << endl;
+#endif
+    }
+
+    // Nanoseconds, small inputs take well under a millisecond on the faster paths
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    double ms = duration.count() / 1e6;
+
+    cout << "Solution took " << ms << " milliseconds on " << options.m_threads << " threads" << endl;
+    cout << "Puzzles/sec " << (ms > 0 ? problemsCount / (ms / 1000) : 0) << endl;
+
+    cout << "Peak worker memory: ";
+    printMemoryFootprint(cout, peakFootprint);
+    if (driverBytes > 0)
+        cout << ", batch driver buffers " << driverBytes << " bytes for " << options.m_threads << " workers";
+    cout << endl;
+
+    if (latencies.count() > 0)
+    {
+        const double usPerTick = clock.nsPerTick() / 1000;
+
+        cout << "Latency, us:";
+        const double PERCENTILES[] = { 50, 90, 99, 99.9 };
+        for (double p : PERCENTILES)
+            cout << " p" << p << "=" << latencies.percentile(p) * usPerTick;
+        cout << " max=" << latencies.maxValue() * usPerTick << endl;
+
+        // Puzzle ids are 0-based positions among the puzzles of the input
+        cout << "Slowest puzzles:";
+        for (const auto& sample : latencies.slowest())
+            cout << " #" << sample.second << " (" << sample.first * usPerTick << " us)";
+        cout << endl;
+    }
+
+#ifdef ALGX_PHASE_TIMERS
+    printPhaseReport(cout, clock.nsPerTick());
+#endif
+
+    // Lockstep solver does not report search nodes
+    if (counters)
+        printHardwareCounters(cout, *counters, problemsCount, searchNodes);
+
+    cin.get();
+
+    return 0;
+}
+
+
+/*
+* Pipeline mode: puzzles come one per line from stdin or a file and every
+* non-blank line produces one line on stdout, the solution or the status
+*/
+int runStream(const Options& options)
+{
+    if (!checkSolverOptions(options))
+        return 1;
+
+    FILE* inputFile = stdin;
+    if (options.m_inputGiven && options.m_inputPath != "-")
+    {
+        inputFile = fopen(options.m_inputPath.c_str(), "rb");
+        if (inputFile == nullptr)
+        {
+            cerr << "Cannot open " << options.m_inputPath << endl;
+            return 1;
+        }
+    }
+
+    LineReader input(inputFile);
+    BufferedWriter output(stdout);
+
+    // Lines of a wrong length become invalid placeholders to keep output aligned
+    auto fill = [&](char* puzzles, size_t capacity)
+    {
+        size_t count = 0;
+        string_view line;
+        while (count < capacity && input.nextLine(line))
+        {
+            if (line.empty())
+                continue;
+
+            if (line.size() == 81)
+                memcpy(puzzles + count * 81, line.data(), 81);
+            else
+                memset(puzzles + count * 81, 'x', 81);
+            ++count;
+        }
+        return count;
+    };
+
+    auto emit = [&](const char*, const char* solutions, const Status* statuses, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (statuses[i] == Status::Solved)
+                output.write(solutions + i * 81, 81);
+            else
+                output.write(statusName(statuses[i]), strlen(statusName(statuses[i])));
+            output.put('\n');
+        }
+    };
+
+    BatchDriver driver(options.m_threads, options.m_chunkSize, solverFactory(options));
+    driver.run(fill, emit);
+
+    output.flush();
+    if (inputFile != stdin)
+        fclose(inputFile);
+
+    return 0;
+}
+
+
+/*
+* Measures pure batch driver overhead per puzzle: workers get a solver which
+* does nothing, so all the time goes to filling, queueing and reordering
+*/
+int runQueueBenchmark(const Options& options)
+{
+    const size_t PUZZLES_COUNT = 1 << 22;
+    const size_t CHUNK_SIZES[] = { 1, 4, 16, 64, 256, 1024, 4096 };
+
+    auto noopFactory = []() -> BatchSolveFn
+    {
+        return [](const char*, size_t, char*, Status*) {};
+    };
+
+    cout << "Queue overhead on " << options.m_threads << " threads, " << PUZZLES_COUNT << " puzzles" << endl;
+    for (size_t chunkSize : CHUNK_SIZES)
+    {
+        BatchDriver driver(options.m_threads, chunkSize, noopFactory);
+
+        // Only counts are produced, puzzle bytes are never touched
+        size_t left = PUZZLES_COUNT;
+        auto fill = [&](char*, size_t capacity)
+        {
+            size_t count = min(capacity, left);
+            left -= count;
+            return count;
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        driver.run(fill, [](const char*, const char*, const Status*, size_t) {});
+        double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+        cout << "chunk " << chunkSize << ": " << ns / PUZZLES_COUNT << " ns/puzzle, " << ns / ((PUZZLES_COUNT + chunkSize - 1) / chunkSize) << " ns/chunk" << endl;
+    }
+
+    return 0;
+}
+
+
+struct MatrixShape
+{
+    uint16_t m_rows;
+    uint16_t m_columns;
+    uint16_t m_nodesPerRow;
+};
+
+
+/*
+* Random matrix as (row, column) pairs. Every row gets the same number of distinct
+* columns and nodes go in row by row with ascending columns, the way matrix
+* builders add them. Planted matrices start with rows partitioning the columns,
+* so the exact cover has at least one solution
+*/
+vector<pair<uint16_t, uint16_t>> randomMatrix(const MatrixShape& shape, mt19937& random, bool planted)
+{
+    vector<pair<uint16_t, uint16_t>> nodes;
+    vector<uint16_t> columns(shape.m_columns);
+    for (uint16_t c = 0; c < shape.m_columns; ++c)
+        columns[c] = c;
+
+    uint16_t r = 0;
+    if (planted)
+    {
+        assert(shape.m_columns % shape.m_nodesPerRow == 0);
+        shuffle(columns.begin(), columns.end(), random);
+        for (; r < shape.m_columns / shape.m_nodesPerRow; ++r)
+        {
+            sort(columns.begin() + r * shape.m_nodesPerRow, columns.begin() + (r + 1) * shape.m_nodesPerRow);
+            for (uint16_t k = 0; k < shape.m_nodesPerRow; ++k)
+                nodes.emplace_back(r, columns[r * shape.m_nodesPerRow + k]);
+        }
+    }
+
+    for (; r < shape.m_rows; ++r)
+    {
+        for (uint16_t k = 0; k < shape.m_nodesPerRow; ++k)
+            swap(columns[k], columns[k + random() % (shape.m_columns - k)]);
+        sort(columns.begin(), columns.begin() + shape.m_nodesPerRow);
+        for (uint16_t k = 0; k < shape.m_nodesPerRow; ++k)
+            nodes.emplace_back(r, columns[k]);
+    }
+
+    return nodes;
+}
+
+
+/*
+* Times SparseTable primitives in isolation on random matrices; nodes/op is the
+* number of nodes one call walks or relinks, so per-node cost can be told apart
+* from matrix shape
+*/
+int runTableBenchmark(const Options& options)
+{
+    // First one is close to the classic sudoku matrix
+    const MatrixShape SHAPES[] = { { 729, 324, 4 }, { 1000, 100, 5 }, { 1000, 100, 20 }, { 4000, 500, 5 }, { 2000, 200, 25 }, { 500, 2000, 100 } };
+    const double MIN_NS = 2e7;
+
+    mt19937 random(static_cast<uint32_t>(options.m_seed));
+
+    auto elapsedNs = [](chrono::steady_clock::time_point start)
+    {
+        return static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    };
+
+    auto report = [](const char* name, double ns, double ops, double nodes)
+    {
+        cout << "  " << name << ": " << ns / ops << " ns/op, " << nodes / ops << " nodes/op" << endl;
+    };
+
+    for (const MatrixShape& shape : SHAPES)
+    {
+        const uint16_t nodesCount = static_cast<uint16_t>(shape.m_rows * shape.m_nodesPerRow);
+        cout << "Matrix " << shape.m_rows << "x" << shape.m_columns << ", " << shape.m_nodesPerRow << " nodes/row, " << nodesCount << " nodes" << endl;
+
+        const vector<pair<uint16_t, uint16_t>> nodes = randomMatrix(shape, random, false);
+
+        // Insertion walks the row and the column from their heads
+        double buildTouched = 0;
+        vector<uint16_t> rowLengths(shape.m_rows, 0), columnLengths(shape.m_columns, 0);
+        for (const auto& node : nodes)
+            buildTouched += rowLengths[node.first]++ + columnLengths[node.second]++;
+
+        double ns = 0, ops = 0, touched = 0;
+        while (ns < MIN_NS)
+        {
+            SparseTable<> table(shape.m_rows, shape.m_columns, nodesCount);
+
+            auto start = chrono::steady_clock::now();
+            for (const auto& node : nodes)
+                table.createNode(node.first, node.second);
+            ns += elapsedNs(start);
+            ops += nodes.size();
+            touched += buildTouched;
+        }
+        report("createNode", ns, ops, touched);
+
+        SparseTable<true> table(shape.m_rows, shape.m_columns, nodesCount);
+        SparseTable<false> bareTable(shape.m_rows, shape.m_columns, nodesCount);
+        for (const auto& node : nodes)
+        {
+            table.createNode(node.first, node.second);
+            bareTable.createNode(node.first, node.second);
+        }
+
+        auto timeRows = [&](auto& rowsTable, const char* name)
+        {
+            double rowsNs = 0, rowsOps = 0, rowsTouched = 0;
+            while (rowsNs < MIN_NS)
+            {
+                auto start = chrono::steady_clock::now();
+                for (uint16_t r = 0; r < shape.m_rows; ++r)
+                {
+                    rowsTable.ejectRow(r);
+                    rowsTable.restoreRow(r);
+                }
+                rowsNs += elapsedNs(start);
+                rowsOps += 2 * shape.m_rows;
+                rowsTouched += 2 * nodesCount;
             }
+            report(name, rowsNs, rowsOps, rowsTouched);
+        };
+        timeRows(table, "ejectRow/restoreRow");
+        timeRows(bareTable, "ejectRow/restoreRow, no row list");
+
+        ns = ops = touched = 0;
+        while (ns < MIN_NS)
+        {
+            auto start = chrono::steady_clock::now();
+            for (uint16_t c = 0; c < shape.m_columns; ++c)
+            {
+                table.ejectColumn(c);
+                table.restoreColumn(c);
+            }
+            ns += elapsedNs(start);
+            ops += 2 * shape.m_columns;
+            touched += 2 * nodesCount;
+        }
+        report("ejectColumn/restoreColumn", ns, ops, touched);
+
+        // Result goes to a volatile, so the scans cannot be dropped
+        ns = ops = 0;
+        volatile uint16_t pivotId = 0;
+        while (ns < MIN_NS)
+        {
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < 1000; ++i)
+                pivotId = table.m_columns.idOf(*table.findShortestColumn());
+            ns += elapsedNs(start);
+            ops += 1000;
+        }
+        report("findPivotColumn", ns, ops, ops * shape.m_columns);
+        (void)pivotId;
+    }
+
+    return 0;
+}
+
+
+// Prints every puzzle with its score and grade, followed by grades summary
+int runRating(const Options& options)
+{
+    SudokuConstraints constraints = variantConstraints(options.m_variant);
+    if (constraints.empty())
+    {
+        cerr << "Unknown or malformed variant " << options.m_variant << endl;
+        return 1;
+    }
+
+    MappedPuzzleFile input(options.m_inputPath);
+    if (!input.isOpen())
+    {
+        cerr << "Cannot open " << options.m_inputPath << endl;
+        return 1;
+    }
+
+    SudokuSolver solver(constraints);
+    configureSolver(solver, options);
+
+    size_t grades[4] = {};
+    size_t unsolved = 0;
+    char solution[81];
+
+    for (const char* puzzle = input.nextPuzzle(); puzzle != nullptr; puzzle = input.nextPuzzle())
+    {
+        cout.write(puzzle, 81);
+
+        if (solver.solve(puzzle, solution) != Status::Solved)
+        {
+            ++unsolved;
+            cout << " - unsolved\n";
+            continue;
+        }
+
+        const SearchStats& stats = solver.lastStats();
+        DifficultyRating rating = rateDifficulty(stats);
+        ++grades[static_cast<int>(rating.m_grade)];
+
+        cout << ' ' << rating.m_score << ' ' << difficultyName(rating.m_grade) <<
+            " nodes=" << stats.m_nodesVisited << " depth=" << stats.m_maxDepth <<
+            " backtracks=" << stats.m_backtracks << " forced=" << stats.m_forcedSteps;
+#ifdef ALGX_MEMS
+        printMemsCounters(cout, solver.lastCounters());
+#endif
+        cout << '\n';
+    }
+
+    cout << "--------------------" << endl;
+    for (int grade = 0; grade < 4; ++grade)
+        cout << difficultyName(static_cast<Difficulty>(grade)) << ": " << grades[grade] << endl;
+    cout << "unsolved: " << unsolved << endl;
+
+    return 0;
+}
+
+
+// Prints generated puzzles to stdout, statistics go to stderr to keep output pipeable
+int runGenerator(const Options& options)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    vector<char> puzzles(options.m_generateCount * 81);
+    generatePuzzles(options.m_generateCount, options.m_generator, options.m_threads, options.m_seed, puzzles.data());
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    double ms = max<double>(1, duration.count());
+
+    for (size_t i = 0; i < options.m_generateCount; ++i)
+    {
+        cout.write(&puzzles[i * 81], 81);
+        cout << '\n';
+    }
+    cout.flush();
+
+    cerr << "Generation took " << ms << " milliseconds on " << options.m_threads << " threads" << endl;
+    cerr << "Unique puzzles/sec " << options.m_generateCount / (ms / 1000) << endl;
+
+    return 0;
+}
+
+
+// Corpus files live in the directory given as input path, one file per stratum
+string corpusPath(const Options& options, Stratum stratum)
+{
+    return (options.m_inputGiven ? options.m_inputPath : string(".")) + "/strata_" + stratumName(stratum) + ".txt";
+}
+
+
+int runCorpusGenerator(const Options& options)
+{
+    vector<char> puzzles(options.m_corpusCount * 81);
+
+    for (int s = 0; s < static_cast<int>(Stratum::Count); ++s)
+    {
+        const Stratum stratum = static_cast<Stratum>(s);
+        const string path = corpusPath(options, stratum);
+
+        auto start = std::chrono::steady_clock::now();
+        generateCorpus(stratum, options.m_corpusCount, options.m_threads, options.m_seed, puzzles.data());
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+        ofstream output(path, ofstream::out | ofstream::binary);
+        for (size_t i = 0; i < options.m_corpusCount; ++i)
+        {
+            output.write(&puzzles[i * 81], 81);
+            output.put('\n');
         }
+
+        if (!output)
+        {
+            cerr << "Cannot write " << path << endl;
+            return 1;
+        }
+
+        cerr << path << ": " << options.m_corpusCount << " puzzles in " << duration.count() << " milliseconds" << endl;
+    }
+
+    return 0;
+}
+
+
+struct StratumResult
+{
+    Stratum m_stratum;
+    size_t m_puzzles = 0;
+    double m_puzzlesPerSec = 0;
+    double m_p50Us = 0;
+    double m_p99Us = 0;
+    double m_nodesPerPuzzle = 0;
+
+    // Puzzles whose status differs from the one the stratum is built for
+    size_t m_mismatches = 0;
+};
+
+
+/*
+* Solves the whole stratum file with one scalar solver, so search statistics
+* are available per puzzle. Counters, if given, run over the solving loop only.
+* Returns false if the file cannot be opened
+*/
+bool benchmarkStratum(const Options& options, Stratum stratum, StratumResult& result, HardwareCounters* counters = nullptr)
+{
+    MappedPuzzleFile input(corpusPath(options, stratum));
+    if (!input.isOpen())
+        return false;
+
+    const Status expected = stratum == Stratum::Unsolvable ? Status::NoSolution : Status::Solved;
+
+    SudokuSolver solver;
+    configureSolver(solver, options);
+    char solution[81];
+    LatencyClock clock;
+    LatencyHistogram latencies;
+    uint64_t nodes = 0;
+
+    result = StratumResult();
+    result.m_stratum = stratum;
+
+    if (counters != nullptr)
+        counters->start();
+    auto start = std::chrono::steady_clock::now();
+    for (const char* puzzle = input.nextPuzzle(); puzzle != nullptr; puzzle = input.nextPuzzle())
+    {
+        uint64_t puzzleStart = LatencyClock::now();
+        Status status = solver.solve(puzzle, solution);
+        latencies.record(LatencyClock::now() - puzzleStart, result.m_puzzles);
+
+        nodes += solver.lastStats().m_nodesVisited;
+        if (status != expected)
+            ++result.m_mismatches;
+        ++result.m_puzzles;
+    }
+    if (counters != nullptr)
+        counters->stop();
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+    if (result.m_puzzles > 0)
+    {
+        const double usPerTick = clock.nsPerTick() / 1000;
+        result.m_puzzlesPerSec = result.m_puzzles / (ns / 1e9);
+        result.m_p50Us = latencies.percentile(50) * usPerTick;
+        result.m_p99Us = latencies.percentile(99) * usPerTick;
+        result.m_nodesPerPuzzle = static_cast<double>(nodes) / result.m_puzzles;
+    }
+
+    return true;
+}
+
+
+// Every metric is reduced to its median over the runs separately
+bool benchmarkStratumMedian(const Options& options, Stratum stratum, StratumResult& result)
+{
+    vector<StratumResult> runs(options.m_runs);
+    for (auto& run : runs)
+    {
+        if (!benchmarkStratum(options, stratum, run))
+            return false;
+    }
+
+    auto median = [&runs](double StratumResult::* field)
+    {
+        vector<double> values;
+        for (const auto& run : runs)
+            values.push_back(run.*field);
+        nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        return values[values.size() / 2];
+    };
+
+    result = runs.front();
+    result.m_puzzlesPerSec = median(&StratumResult::m_puzzlesPerSec);
+    result.m_p50Us = median(&StratumResult::m_p50Us);
+    result.m_p99Us = median(&StratumResult::m_p99Us);
+
+    return true;
+}
+
+
+void writeStrataJson(ostream& stream, const vector<StratumResult>& results, int runs)
+{
+    const auto precision = stream.precision(12);
+
+    stream << "{\n  \"runs\": " << runs << ",\n  \"strata\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const StratumResult& r = results[i];
+        stream << (i > 0 ? "," : "") << "\n    { \"name\": \"" << stratumName(r.m_stratum) << "\", \"puzzles\": " << r.m_puzzles <<
+            ", \"puzzles_per_sec\": " << r.m_puzzlesPerSec << ", \"p50_us\": " << r.m_p50Us << ", \"p99_us\": " << r.m_p99Us <<
+            ", \"nodes_per_puzzle\": " << r.m_nodesPerPuzzle << ", \"mismatches\": " << r.m_mismatches << " }";
     }
+    stream << "\n  ]\n}" << endl;
+
+    stream.precision(precision);
+}
+
+
+/*
+* Reads strata back from a file written by writeStrataJson. This is not a general
+* JSON parser: every stratum has to be a flat object with a known name. A file
+* without any stratum is an error, so an empty baseline never passes the gate
+*/
+bool readStrataJson(const string& path, vector<StratumResult>& results)
+{
+    ifstream input(path);
+    if (!input)
+        return false;
+
+    const string text((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
 
-    int packRowID(int i, int j, int v)
+    auto number = [](const string& object, const char* key, double& value)
     {
-        return i * PROBLEM_SIZE * PROBLEM_SIZE + j * PROBLEM_SIZE + v;
+        size_t pos = object.find("\"" + string(key) + "\"");
+        if (pos == string::npos || (pos = object.find(':', pos)) == string::npos)
+            return false;
+        value = strtod(object.c_str() + pos + 1, nullptr);
+        return true;
+    };
+
+    size_t pos = text.find("\"strata\"");
+    if (pos == string::npos)
+        return false;
+
+    while ((pos = text.find('{', pos)) != string::npos)
+    {
+        size_t end = text.find('}', pos);
+        if (end == string::npos)
+            return false;
+        const string object = text.substr(pos, end - pos);
+        pos = end;
+
+        StratumResult result;
+        bool known = false;
+        for (int s = 0; s < static_cast<int>(Stratum::Count); ++s)
+        {
+            if (object.find("\"" + string(stratumName(static_cast<Stratum>(s))) + "\"") != string::npos)
+            {
+                result.m_stratum = static_cast<Stratum>(s);
+                known = true;
+            }
+        }
+
+        double puzzles = 0, mismatches = 0;
+        if (!known || !number(object, "puzzles", puzzles) || !number(object, "puzzles_per_sec", result.m_puzzlesPerSec) ||
+            !number(object, "p50_us", result.m_p50Us) || !number(object, "p99_us", result.m_p99Us) ||
+            !number(object, "nodes_per_puzzle", result.m_nodesPerPuzzle) || !number(object, "mismatches", mismatches))
+        {
+            return false;
+        }
+
+        result.m_puzzles = static_cast<size_t>(puzzles);
+        result.m_mismatches = static_cast<size_t>(mismatches);
+        results.push_back(result);
     }
 
-    int packColID(int i, int j)
+    return !results.empty();
+}
+
+
+/*
+* Regression gate: throughput may drop by the threshold and the noisier p99 may
+* grow by twice as much. Search nodes are deterministic for the same corpus,
+* so any growth there counts too
+*/
+bool compareStrata(ostream& stream, const vector<StratumResult>& baseline, const vector<StratumResult>& current, double threshold)
+{
+    bool passed = true;
+
+    for (const StratumResult& base : baseline)
     {
-        return i * PROBLEM_SIZE + j;
+        auto it = find_if(current.begin(), current.end(), [&base](const StratumResult& r) { return r.m_stratum == base.m_stratum; });
+        if (it == current.end())
+        {
+            stream << stratumName(base.m_stratum) << ": missing in the current run" << endl;
+            passed = false;
+            continue;
+        }
+
+        const double speed = it->m_puzzlesPerSec / base.m_puzzlesPerSec - 1;
+        const double tail = it->m_p99Us / base.m_p99Us - 1;
+        const bool regressed = speed < -threshold || tail > 2 * threshold || it->m_nodesPerPuzzle > base.m_nodesPerPuzzle * (1 + 1e-9) ||
+            it->m_puzzles != base.m_puzzles || it->m_mismatches > base.m_mismatches;
+
+        stream << stratumName(base.m_stratum) << ": " << it->m_puzzlesPerSec << " puzzles/sec (" << showpos << speed * 100 << noshowpos <<
+            "%), p99 " << it->m_p99Us << " us (" << showpos << tail * 100 << noshowpos << "%), nodes/puzzle " << it->m_nodesPerPuzzle <<
+            " vs " << base.m_nodesPerPuzzle << (regressed ? " REGRESSION" : " ok") << endl;
+
+        passed = passed && !regressed;
     }
 
-    int getBoxID(int i, int j)
+    for (const StratumResult& result : current)
     {
-        return (j / 3) * 3 + (i / 3);
+        auto it = find_if(baseline.begin(), baseline.end(), [&result](const StratumResult& r) { return r.m_stratum == result.m_stratum; });
+        if (it == baseline.end())
+        {
+            stream << stratumName(result.m_stratum) << ": missing in the baseline" << endl;
+            passed = false;
+        }
     }
+
+    return passed;
+}
+
+
+#pragma pack(push,1)
+// Trace file is a sequence of these, each followed by its records
+struct TraceFileChunk
+{
+    uint32_t m_puzzle;
+    uint32_t m_records;
+    uint64_t m_dropped;
 };
+#pragma pack(pop)
+
 
-int main()
+// Solves every puzzle of the input and writes its search trace to the trace file
+int runTrace(const Options& options)
 {
-    // Benchmarking based on easy kaggle set
-    // ifstream benchmark_input("test_sudoku_full.txt");
-    ifstream benchmark_input("test_sudoku.txt");
+#ifdef ALGX_TRACE
+    if (!checkSolverOptions(options))
+        return 1;
 
-    auto start = std::chrono::steady_clock::now();
+    MappedPuzzleFile input(options.m_inputPath);
+    if (!input.isOpen())
+    {
+        cerr << "Cannot open " << options.m_inputPath << endl;
+        return 1;
+    }
+
+    ofstream output(options.m_tracePath, ofstream::out | ofstream::binary);
+    SudokuSolver solver(variantConstraints(options.m_variant));
+    configureSolver(solver, options);
+    char solution[81];
+
+    uint32_t puzzleId = 0;
+    for (const char* puzzle = input.nextPuzzle(); puzzle != nullptr; puzzle = input.nextPuzzle(), ++puzzleId)
+    {
+        solver.solve(puzzle, solution);
+
+        const SearchTrace& trace = solver.lastTrace();
+        TraceFileChunk chunk = { puzzleId, static_cast<uint32_t>(trace.size()), trace.dropped() };
+        output.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+        for (size_t i = 0; i < trace.size(); ++i)
+            output.write(reinterpret_cast<const char*>(&trace[i]), sizeof(TraceRecord));
+    }
+
+    if (!output)
+    {
+        cerr << "Cannot write " << options.m_tracePath << endl;
+        return 1;
+    }
+
+    return 0;
+#else
+    (void)options;
+    cerr << "Search trace needs a build with ALGX_TRACE defined" << endl;
+    return 1;
+#endif
+}
+
+
+/*
+* Converts a trace file to folded stacks for flame graph tools (one line per
+* tried row, weighted 1, so frame widths are subtree sizes) or to a DOT graph.
+* Ancestors lost to the ring buffer wrap show up as "?" frames
+*/
+int runTraceDump(const Options& options)
+{
+    const bool dot = options.m_traceFormat == "dot";
+    if (!dot && options.m_traceFormat != "folded")
+    {
+        cerr << "Unknown trace format " << options.m_traceFormat << endl;
+        return 1;
+    }
+
+    ifstream input(options.m_traceDumpPath, ifstream::in | ifstream::binary);
+    if (!input)
+    {
+        cerr << "Cannot open " << options.m_traceDumpPath << endl;
+        return 1;
+    }
+
+    auto frameName = [](const TraceRecord& record)
+    {
+        switch (record.m_outcome)
+        {
+        case TraceOutcome::Solution:
+            return string("solution");
+        case TraceOutcome::DeadEnd:
+            return "dead-end c" + to_string(record.m_columnId);
+        default:
+            return "c" + to_string(record.m_columnId) + "/" + to_string(record.m_columnSize) + " r" + to_string(record.m_rowId);
+        }
+    };
+
+    if (dot)
+        cout << "digraph search {\n  node [shape=box, fontname=monospace];\n";
+
+    TraceFileChunk chunk;
+    vector<TraceRecord> records;
+    while (input.read(reinterpret_cast<char*>(&chunk), sizeof(chunk)))
+    {
+        records.resize(chunk.m_records);
+        if (!input.read(reinterpret_cast<char*>(records.data()), chunk.m_records * sizeof(TraceRecord)))
+        {
+            cerr << "Truncated trace file" << endl;
+            return 1;
+        }
+
+        const string root = "puzzle" + to_string(chunk.m_puzzle);
+
+        // Path of frames (or DOT node ids) from the root to the current depth
+        vector<string> path;
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            const TraceRecord& record = records[i];
+            path.resize(record.m_depth, dot ? root : "?");
+
+            const string name = frameName(record);
+            if (dot)
+            {
+                const string id = root + "_" + to_string(i);
+                const char* color = record.m_outcome == TraceOutcome::Solution || record.m_outcome == TraceOutcome::Done ? "green" :
+                    record.m_outcome == TraceOutcome::DeadEnd ? "red" : "black";
+                cout << "  " << id << " [label=\"" << name << "\", color=" << color << "];\n";
+                cout << "  " << (path.empty() ? root : path.back()) << " -> " << id << ";\n";
+                path.push_back(id);
+            }
+            else
+            {
+                cout << root;
+                if (chunk.m_dropped > 0)
+                    cout << ";truncated";
+                for (const auto& frame : path)
+                    cout << ';' << frame;
+                cout << ';' << name << " 1\n";
+                path.push_back(name);
+            }
+        }
+    }
+
+    if (dot)
+        cout << "}" << endl;
+
+    return 0;
+}
+
+
+/*
+* Undo strategies against walk-based restore on every stratum corpus, from
+* shallow (singles) to deep (search-heavy) search trees, then on planted random
+* exact cover matrices of growing state size, where the snapshot crossover shows
+*/
+int runUndoBenchmark(const Options& options)
+{
+    const pair<UndoStrategy, const char*> STRATEGIES[] = { { UndoStrategy::Trail, "trail" }, { UndoStrategy::Snapshot, "snapshot" } };
+
+    // Two rows per column keep the trees small enough to search them whole
+    const MatrixShape SHAPES[] = { { 100, 50, 5 }, { 200, 100, 5 }, { 400, 200, 5 }, { 300, 100, 10 }, { 600, 200, 10 }, { 500, 200, 20 } };
+    const uint32_t SOLUTIONS_LIMIT = 50;
+    const double MIN_NS = 2e8;
 
-    int problemsCount = 0;
-    while (!benchmark_input.eof())
+    for (int s = 0; s < static_cast<int>(Stratum::Count); ++s)
     {
-        string input;
-        benchmark_input >> input;
-        if (input.size() != 81)
+        const Stratum stratum = static_cast<Stratum>(s);
+
+        Options strategyOptions = options;
+        strategyOptions.m_undo = UndoStrategy::Walk;
+
+        StratumResult walk;
+        if (!benchmarkStratumMedian(strategyOptions, stratum, walk))
+        {
+            cerr << stratumName(stratum) << ": no corpus at " << corpusPath(options, stratum) << endl;
             continue;
+        }
 
-        SudokuProblem p(input);
-        p.solve();
+        cout << stratumName(stratum) << ", " << walk.m_nodesPerPuzzle << " nodes/puzzle: walk " << walk.m_puzzlesPerSec << " puzzles/sec";
+        for (const auto& strategy : STRATEGIES)
+        {
+            strategyOptions.m_undo = strategy.first;
 
-        ++problemsCount;
+            StratumResult result;
+            benchmarkStratumMedian(strategyOptions, stratum, result);
+            cout << ", " << strategy.second << " " << result.m_puzzlesPerSec << " (" << showpos << (result.m_puzzlesPerSec / walk.m_puzzlesPerSec - 1) * 100 <<
+                noshowpos << "%)";
+        }
+        cout << endl;
     }
 
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
-    double ms = duration.count();
+    mt19937 random(static_cast<uint32_t>(options.m_seed));
 
-    cout << "Solution took " << ms << " milliseconds" << endl;
-    cout << "Puzzles/sec " << problemsCount / (ms / 1000) << endl;
+    for (const MatrixShape& shape : SHAPES)
+    {
+        const vector<pair<uint16_t, uint16_t>> nodes = randomMatrix(shape, random, true);
 
-    cin.get();
+        // Search nodes are the same for every strategy, time per node is compared
+        auto nsPerNode = [&](UndoStrategy strategy, size_t& stateBytes)
+        {
+            AlgorithmX algorithm(shape.m_rows, shape.m_columns, static_cast<uint16_t>(nodes.size()));
+            for (const auto& node : nodes)
+                algorithm.createNode(node.first, node.second);
+            algorithm.setUndoStrategy(strategy);
+
+            double ns = 0, visited = 0;
+            while (ns < MIN_NS)
+            {
+                auto start = chrono::steady_clock::now();
+                algorithm.countSolutions(SOLUTIONS_LIMIT);
+                ns += static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+                visited += algorithm.getStats().m_nodesVisited;
+                algorithm.reset();
+            }
+
+            stateBytes = algorithm.stateBytes();
+            return ns / max(1.0, visited);
+        };
+
+        size_t stateBytes = 0;
+        const double walk = nsPerNode(UndoStrategy::Walk, stateBytes);
+        cout << "Matrix " << shape.m_rows << "x" << shape.m_columns << ", " << stateBytes << " state bytes: walk " << walk << " ns/node";
+        for (const auto& strategy : STRATEGIES)
+        {
+            const double ns = nsPerNode(strategy.first, stateBytes);
+            cout << ", " << strategy.second << " " << ns << " (" << showpos << (walk / ns - 1) * 100 << noshowpos << "%)";
+        }
+        cout << endl;
+    }
+
+    return 0;
+}
+
+
+/*
+* Node orders against the build one on every stratum corpus. With --perf each
+* order gets one more pass under hardware counters for cache misses per puzzle
+*/
+int runLayoutBenchmark(const Options& options)
+{
+    const pair<NodeOrder, const char*> ORDERS[] = { { NodeOrder::Build, "build" }, { NodeOrder::RowMajor, "row" }, { NodeOrder::ColumnMajor, "column" } };
+
+    for (int s = 0; s < static_cast<int>(Stratum::Count); ++s)
+    {
+        const Stratum stratum = static_cast<Stratum>(s);
+
+        Options orderOptions = options;
+        StratumResult results[3];
+        double l1Misses[3] = {}, llcMisses[3] = {};
+        bool perf = options.m_perf;
+
+        for (int order = 0; order < 3; ++order)
+        {
+            orderOptions.m_layout = ORDERS[order].first;
+            if (!benchmarkStratumMedian(orderOptions, stratum, results[order]))
+                break;
+
+            if (perf)
+            {
+                HardwareCounters counters;
+                StratumResult result;
+                perf = counters.isOpen() && benchmarkStratum(orderOptions, stratum, result, &counters) &&
+                    counters.read(HardwareCounters::L1Misses, l1Misses[order]) && counters.read(HardwareCounters::LlcMisses, llcMisses[order]);
+                l1Misses[order] /= max<size_t>(1, result.m_puzzles);
+                llcMisses[order] /= max<size_t>(1, result.m_puzzles);
+            }
+        }
+
+        if (results[0].m_puzzles == 0)
+        {
+            cerr << stratumName(stratum) << ": no corpus at " << corpusPath(options, stratum) << endl;
+            continue;
+        }
+
+        cout << stratumName(stratum) << ":";
+        for (int order = 0; order < 3; ++order)
+        {
+            cout << (order > 0 ? "," : "") << " " << ORDERS[order].second << " " << results[order].m_puzzlesPerSec << " puzzles/sec";
+            if (order > 0)
+                cout << " (" << showpos << (results[order].m_puzzlesPerSec / results[0].m_puzzlesPerSec - 1) * 100 << noshowpos << "%)";
+        }
+        cout << endl;
+
+        if (perf)
+        {
+            cout << "  L1d/LLC misses per puzzle:";
+            for (int order = 0; order < 3; ++order)
+                cout << (order > 0 ? "," : "") << " " << ORDERS[order].second << " " << l1Misses[order] << "/" << llcMisses[order];
+            cout << endl;
+        }
+        else if (options.m_perf)
+        {
+            cout << "  Cache miss counters are not available" << endl;
+        }
+    }
+
+    return 0;
+}
+
+
+// Returns non-zero when compared against a baseline and any stratum regressed
+int runStrataBenchmark(const Options& options)
+{
+    vector<StratumResult> baseline;
+    if (!options.m_baselinePath.empty() && !readStrataJson(options.m_baselinePath, baseline))
+    {
+        cerr << "Cannot read baseline " << options.m_baselinePath << endl;
+        return 1;
+    }
+
+    vector<StratumResult> results;
+    for (int s = 0; s < static_cast<int>(Stratum::Count); ++s)
+    {
+        const Stratum stratum = static_cast<Stratum>(s);
+
+        StratumResult result;
+        if (!benchmarkStratumMedian(options, stratum, result))
+        {
+            cerr << stratumName(stratum) << ": no corpus at " << corpusPath(options, stratum) << endl;
+            continue;
+        }
+        results.push_back(result);
+
+        if (options.m_json || !baseline.empty())
+            continue;
+
+        cout << stratumName(stratum) << ": " << result.m_puzzles << " puzzles, " << result.m_puzzlesPerSec << " puzzles/sec, p50=" <<
+            result.m_p50Us << " us, p99=" << result.m_p99Us << " us, " << result.m_nodesPerPuzzle << " nodes/puzzle";
+        if (result.m_mismatches > 0)
+            cout << ", " << result.m_mismatches << " unexpected statuses";
+        cout << endl;
+    }
+
+    if (options.m_json)
+        writeStrataJson(cout, results, options.m_runs);
+
+    if (!options.m_baselinePath.empty())
+    {
+        // JSON document keeps stdout to itself
+        return compareStrata(options.m_json ? cerr : cout, baseline, results, options.m_threshold) ? 0 : 1;
+    }
 
     return 0;
 }
+
+
+int main(int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--lockstep")
+            options.m_lockstep = true;
+        else if (arg == "--rate")
+            options.m_rate = true;
+        else if (arg == "--stream")
+            options.m_stream = true;
+        else if (arg == "--queue-bench")
+            options.m_queueBenchmark = true;
+        else if (arg == "--table-bench")
+            options.m_tableBenchmark = true;
+        else if (arg == "--strata")
+            options.m_strata = true;
+        else if (arg == "--corpus" && hasValue)
+            options.m_corpusCount = stoull(argv[++i]);
+        else if (arg == "--json")
+            options.m_json = true;
+        else if (arg == "--perf")
+            options.m_perf = true;
+        else if (arg == "--undo-bench")
+            options.m_undoBenchmark = true;
+        else if (arg == "--layout-bench")
+            options.m_layoutBenchmark = true;
+        else if (arg == "--layout" && hasValue)
+        {
+            string layout = argv[++i];
+            if (layout == "build")
+                options.m_layout = NodeOrder::Build;
+            else if (layout == "row")
+                options.m_layout = NodeOrder::RowMajor;
+            else if (layout == "column")
+                options.m_layout = NodeOrder::ColumnMajor;
+            else
+            {
+                cerr << "Unknown layout " << layout << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--undo" && hasValue)
+        {
+            string undo = argv[++i];
+            if (undo == "walk")
+                options.m_undo = UndoStrategy::Walk;
+            else if (undo == "trail")
+                options.m_undo = UndoStrategy::Trail;
+            else if (undo == "snapshot")
+                options.m_undo = UndoStrategy::Snapshot;
+            else if (undo == "auto")
+                options.m_undo = UndoStrategy::Auto;
+            else
+            {
+                cerr << "Unknown undo strategy " << undo << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--trace" && hasValue)
+            options.m_tracePath = argv[++i];
+        else if (arg == "--trace-dump" && hasValue)
+            options.m_traceDumpPath = argv[++i];
+        else if (arg == "--format" && hasValue)
+            options.m_traceFormat = argv[++i];
+        else if (arg == "--runs" && hasValue)
+            options.m_runs = max(1, stoi(argv[++i]));
+        else if (arg == "--compare" && hasValue)
+            options.m_baselinePath = argv[++i];
+        else if (arg == "--threshold" && hasValue)
+            options.m_threshold = stod(argv[++i]) / 100;
+        else if (arg == "--chunk" && hasValue)
+            options.m_chunkSize = max<size_t>(1, stoull(argv[++i]));
+        else if (arg == "--variant" && hasValue)
+            options.m_variant = argv[++i];
+        else if (arg == "--generate" && hasValue)
+            options.m_generateCount = stoull(argv[++i]);
+        else if (arg == "--min-clues" && hasValue)
+            options.m_generator.m_minClues = stoi(argv[++i]);
+        else if (arg == "--threads" && hasValue)
+            options.m_threads = max(1, stoi(argv[++i]));
+        else if (arg == "--seed" && hasValue)
+            options.m_seed = stoull(argv[++i]);
+        else if (arg == "--symmetry" && hasValue)
+        {
+            string symmetry = argv[++i];
+            if (symmetry == "none")
+                options.m_generator.m_symmetry = Symmetry::None;
+            else if (symmetry == "rotational")
+                options.m_generator.m_symmetry = Symmetry::Rotational;
+            else if (symmetry == "mirror")
+                options.m_generator.m_symmetry = Symmetry::Mirror;
+            else
+            {
+                cerr << "Unknown symmetry " << symmetry << endl;
+                return 1;
+            }
+        }
+        else
+        {
+            options.m_inputPath = arg;
+            options.m_inputGiven = true;
+        }
+    }
+
+    // Generation and streaming are about throughput only, so they take all cores by default
+    if (options.m_threads == 0)
+        options.m_threads = options.m_generateCount > 0 || options.m_corpusCount > 0 || options.m_stream ? max(1u, thread::hardware_concurrency()) : 1;
+
+    if (options.m_generateCount > 0)
+        return runGenerator(options);
+    if (options.m_corpusCount > 0)
+        return runCorpusGenerator(options);
+    if (!options.m_tracePath.empty())
+        return runTrace(options);
+    if (!options.m_traceDumpPath.empty())
+        return runTraceDump(options);
+    if (options.m_strata || !options.m_baselinePath.empty())
+        return runStrataBenchmark(options);
+    if (options.m_undoBenchmark)
+        return runUndoBenchmark(options);
+    if (options.m_layoutBenchmark)
+        return runLayoutBenchmark(options);
+    if (options.m_rate)
+        return runRating(options);
+    if (options.m_stream)
+        return runStream(options);
+    if (options.m_queueBenchmark)
+        return runQueueBenchmark(options);
+    if (options.m_tableBenchmark)
+        return runTableBenchmark(options);
+
+    return runBenchmark(options);
+}